@@ -27,23 +27,20 @@
 // local_ptr types are loaded from or stored into atomic_ptr types.
 // Dereferencing an atomic_ptr has dependent load consistency.
 // 
-// The current implementation has two dependent load barriers when
-// dereferencing an atomic_ptr type, one for the atomic_ptr_ref
-// type and one for the referenced object itself.  This may be somewhat
-// redundant but I'm leaving it that way for now until dependent load
-// "memory barrier" semantics become better understood.
+// The memory order of loads from and stores into an atomic_ptr, and
+// of dropping its link reference, is set by the ordering policy, atomic_ptr's
+// third template parameter (see ordering below).  The default is acquire
+// loads and release stores.  The object pointer in the atomic_ptr_ref is
+// loaded relaxed since it's a dependent load of the ref.
 //
 // Dropping a reference requires a release memory barrier if the
 // resulting reference counts are non zero to prevent late stores
 // into recycled objects.  If the resulting reference counts are zero
 // an acquire memory barrier is required to prevent subsequent stores
-// into the object before the count was dropped to zero.  The current
-// implementation (atomic_ptr_ref::adjust) uses full synchronization
-// handle both cases.  This may change to handle platforms where
-// interlocked instructions don't have memory barriers built in.
-// atomic_ptr_ref::adjust also handles adding references which do
-// not require memory barriers.  A separate method without memory
-// barriers may be created in the future.
+// into the object before the count was dropped to zero.  ~local_ptr and
+// ~atomic_ptr drop w/ a release adjust and an acquire fence only if the
+// counts went to zero.  Adding references does not require memory
+// barriers (atomic_ptr_ref::adjust).
 //
 // notes:
 //   Dereferencing an atomic_ptr generates a local_ptr temp to guarantee
@@ -54,47 +51,493 @@
 //   The recycling pool interface is experimental and may be subject
 // to change.
 //
+//   atomic_ptr<T, packedReference> keeps the differential reference in
+// a single word w/ the ephemeral count in the upper 16 bits of the
+// pointer.  Loads are a single fetch_add instead of a double wide CAS.
+// The default, atomic_ptr<T, differentialReference>, requires -mcx16
+// on x86-64.
+//
+//   atomic_ptr::update does read-copy-update w/ cas retry and backoff.
+// Compile w/ ATOMIC_PTR_UPDATE_STATS to keep per atomic_ptr counts of
+// update attempts and cas failures for finding write contended slots.
+// Compile w/ ATOMIC_PTR_STATS for retry counts and histograms per kind of
+// call site and retry counts per slot, kept per thread and summed by
+// atomic_ptr_stats_dump(), which lists the slots w/ the most retries.
+//
+//   local_ptr(obj, deleter, alloc) destroys obj w/ deleter instead of
+// delete and allocates the ref w/ alloc.  allocate_local is make_local
+// w/ an allocator.  The deleter and allocator are kept in the ref, not
+// the atomic_ptr type, so they don't change the local_ptr or atomic_ptr
+// types.  make_local_array and atomic_ptr_delete_array are for arrays.
+//
 //------------------------------------------------------------------------------
 
 #ifndef _ATOMIC_PTR_H
 #define _ATOMIC_PTR_H
 
 #include <stdlib.h>
+#include <stdint.h>
+#include <memory>			// before stdatomic.h macros
+#include <vector>
 #include <stdatomic.h>
+#include <utility>
+#include <new>
+#include <type_traits>
+#include <climits>
+#include <sched.h>
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
+//=============================================================================
+// ordering -- atomic_ptr memory order policies, selected by atomic_ptr's
+// third template parameter, e.g. atomic_ptr<T, differentialReference,
+// ordering::consume_loads>.
+//
+//   load  -- loading a ref from the atomic_ptr (getrefptr, operator ->)
+//   store -- swapping a ref into the atomic_ptr (swap, store)
+//   drop  -- dropping the atomic_ptr's link reference when it's swapped
+//            out.  An acquire fence is added if the counts go to zero.
+//
+// The object pointer in the ref is loaded relaxed; it's ordered by the
+// dependent load of the ref.
+//=============================================================================
+struct ordering {
+	struct acquire_loads {			// default
+		static constexpr memory_order load = memory_order_acquire;
+		static constexpr memory_order store = memory_order_release;
+		static constexpr memory_order drop = memory_order_release;
+	};
+
+	struct consume_loads {			// dependent load ordering only
+		static constexpr memory_order load = memory_order_consume;
+		static constexpr memory_order store = memory_order_release;
+		static constexpr memory_order drop = memory_order_release;
+	};
+
+	struct seq_cst {				// sequentially consistent loads and stores
+		static constexpr memory_order load = memory_order_seq_cst;
+		static constexpr memory_order store = memory_order_seq_cst;
+		static constexpr memory_order drop = memory_order_acq_rel;
+	};
+};
 
-// Membar defines for atomic_ptr load w/ memory_order_acquire semantics
-#define MEMBAR0 memory_order_acquire
-#define MEMBAR1 memory_order_relaxed
-// Membar defines for atomic_ptr load w/ memory_order_consume semantics
-//#define MEMBAR0 memory_order_consume
-//#define MEMBAR1 memory_order_consime
+template<typename T> struct differentialReference;
+template<typename T> struct packedReference;
 
-template<typename T> class atomic_ptr;
+template<typename T, template<typename> class R = differentialReference, typename O = ordering::acquire_loads> class atomic_ptr;
 template<typename T> class local_ptr;
 template<typename T> class atomic_ptr_ref;
-
-// double word sized integer type to get around illogical c11 atomics restriction
+template<typename T> class atomic_ptr_block;
+template<typename T, typename D, typename A> class atomic_ptr_deleter_ref;
+template<typename T, typename A> class atomic_ptr_alloc_block;
+template<typename T> class atomic_ptr_smr_block;
+template<typename T> class distributed_atomic_ptr_ref;
+template<typename T, template<typename> class R, typename O> class atomic_ptr_guard;
+template<typename T> class local_weak_ptr;
+template<typename T> class atomic_weak_ptr;
+
+// double word sized integer type, for double word alignment
 #if __SIZEOF_LONG__ == 8
 #define ival __int128
 #else
 #define ival int64_t
 #endif
 
+//
+// double word CAS and exchange on the double word struct itself, gcc
+// generic __atomic builtins.  Casting to ival* instead breaks strict
+// aliasing.
+//
+template<typename V> inline bool atomic_ptr_dwcas(V * dest, V * expected, V * xchg, memory_order ms, memory_order mf) {
+	static_assert(sizeof(V) == sizeof(ival), "double word type");
+	return __atomic_compare_exchange(dest, expected, xchg, false, (int)ms, (int)mf);
+}
+
+template<typename V> inline void atomic_ptr_dwexchange(V * dest, V * val, V * ret, memory_order mo) {
+	static_assert(sizeof(V) == sizeof(ival), "double word type");
+	__atomic_exchange(dest, val, ret, (int)mo);
+}
 
+
+#ifdef ATOMIC_PTR_PACKED_REFCOUNT
+//
+// Packed refcount, rcount * 2^32 + ecount in a single 64 bit word.
+// Adjusting is a single fetch_add of the combined delta and both counts
+// are zero iff the word is zero.  The ephemeral count can go negative
+// and must stay within 32 bits.  A slot's loads drive its ref's ecount
+// negative until the slot is stored into, so both slot types periodically
+// transfer ephemeral counts from the slot into the refcount, packedReference
+// every 2^14 loads and differentialReference every 2^24.  The remaining
+// limit is 2^31 live local_ptrs plus atomic_ptr links to one object.
+//
 struct refcount {
+	int64_t	val;
+
+	static int64_t pack(long ecount, long rcount) {
+		return (int64_t)rcount * ((int64_t)1 << 32) + ecount;
+	}
+
+	void set(long ecount, long rcount) { val = pack(ecount, rcount); }
+};
+#else
+struct alignas(sizeof(ival)) refcount {
 	long	ecount;	// ephemeral count
 	long	rcount;	// reference count
+
+	void set(long xecount, long xrcount) {
+		ecount = xecount;
+		rcount = xrcount;
+	}
 };
+#endif
+
+typedef void (*pool_put_t)(void *);
 
 //
-// Differential reference to allow race free access to reference count
+// count of interlocked refcount/link updates by current thread (debugging)
 //
-template<typename T> struct differentialReference {
-	long	ecount; // ephemeral count
-	atomic_ptr_ref<T> *ptr;
+#ifdef ATOMIC_PTR_CASCOUNT
+inline long & atomic_ptr_cascount() { static thread_local long n = 0; return n; }
+#define CASCOUNT() (atomic_ptr_cascount()++)
+#else
+#define CASCOUNT()
+#endif
+
+//
+// retry statistics for interlocked refcount/link update loops, compile
+// w/ ATOMIC_PTR_STATS.  Each call site kind gets a call count, a retry
+// count and a histogram of retries per call in thread local counters.
+// Probes also name the slot, the atomic_ptr or ref being updated, which
+// is counted in a small thread local hash table so the dump can list the
+// slots w/ the most retries; slots that don't fit are counted untracked.
+// Threads' counters are in a list that atomic_ptr_stats_dump sums; a
+// thread's counters are reused by a later thread after it exits.  Dump
+// and reset are no-ops w/o ATOMIC_PTR_STATS and the probes compile to
+// nothing.
+//
+enum atomic_ptr_site {
+	site_adjust,			// atomic_ptr_ref::adjust
+	site_adjust_mb,			// atomic_ptr_ref::adjust_mb
+	site_adjust_weak,		// atomic_ptr_ref::adjustWeak
+	site_tryacquire,		// atomic_ptr_ref::tryacquire
+	site_acquire,			// getrefptr, loads from atomic_ptr
+	site_exchange,			// stores into atomic_ptr
+	site_cas,				// atomic_ptr::cas, compare_exchange
+	site_transfer,			// slot to refcount ecount transfer
+	site_update,			// atomic_ptr::update attempts
+	atomic_ptr_nsites
 };
 
-typedef void (*pool_put_t)(void *);
+#ifdef ATOMIC_PTR_STATS
+#include <stdio.h>
+#include <algorithm>
+
+struct atomic_ptr_stats {
+	static const int nbuckets = 7;		// retries 0, 1, 2-3, 4-7, 8-15, 16-31, 32+
+	static const int nslots = 64;		// per thread slot table, power of 2
+	static const int nprobes = 8;		// linear probes before a slot is untracked
+
+	struct counters {
+		long	calls;
+		long	retries;
+		long	histogram[nbuckets];
+	};
+
+	struct slotcounters {
+		const void *	slot;			// atomic_ptr or ref, null if free
+		int				site;
+		long			calls;
+		long			retries;
+	};
+
+	counters			site[atomic_ptr_nsites];
+	slotcounters		slots[nslots];
+	long				untracked;			// calls on slots not in table
+	atomic_ptr_stats *	next;
+	bool				owned;				// in use by a thread
+
+	static const char * name(int site) {
+		static const char * names[atomic_ptr_nsites] = {
+			"adjust", "adjust_mb", "adjustWeak", "tryacquire", "acquire",
+			"exchange", "cas", "transfer", "update"
+		};
+		return names[site];
+	}
+
+	static atomic_ptr_stats * & head() { static atomic_ptr_stats * list = nullptr; return list; }
+
+	// claim a free block or add a new one to the list
+	static atomic_ptr_stats * claim() {
+		for (atomic_ptr_stats * p = atomic_load_explicit(&head(), memory_order_acquire); p != nullptr; p = p->next) {
+			bool expected = false;
+			if (atomic_compare_exchange_strong_explicit(&p->owned, &expected, true, memory_order_acquire, memory_order_relaxed))
+				return p;
+		}
+
+		atomic_ptr_stats * p = new atomic_ptr_stats();
+		p->owned = true;
+		p->next = atomic_load_explicit(&head(), memory_order_relaxed);
+		while (!atomic_compare_exchange_strong_explicit(&head(), &p->next, p, memory_order_release, memory_order_relaxed));
+		return p;
+	}
+
+	struct holder {
+		atomic_ptr_stats * stats;
+		holder() : stats(claim()) {}
+		~holder() { atomic_store_explicit(&stats->owned, false, memory_order_release); }
+	};
+
+	static atomic_ptr_stats * local() {
+		static thread_local holder h;
+		return h.stats;
+	}
+
+	// only the owning thread writes, relaxed stores are plain moves
+	static void bump(long & n, long delta) {
+		atomic_store_explicit(&n, atomic_load_explicit(&n, memory_order_relaxed) + delta, memory_order_relaxed);
+	}
+
+	// find or add slot/site, null if the probe sequence is full
+	slotcounters * lookup(const void * slot, int site) {
+		uintptr_t h = (((uintptr_t)slot >> 4) ^ (uintptr_t)site) * 0x9e3779b97f4a7c15ull;
+		unsigned int ndx = (unsigned int)(h >> 32);
+
+		for (int j = 0; j < nprobes; j++) {
+			slotcounters * s = &slots[(ndx + j) & (nslots - 1)];
+			const void * cur = atomic_load_explicit(&s->slot, memory_order_relaxed);
+			if (cur == slot && s->site == site)
+				return s;
+			if (cur == nullptr) {
+				s->site = site;
+				atomic_store_explicit(&s->slot, slot, memory_order_release);	// site before slot
+				return s;
+			}
+		}
+		return nullptr;
+	}
+
+	static void record(int site, const void * slot, long retries) {
+		atomic_ptr_stats * p = local();
+		counters & c = p->site[site];
+		int b = 0;
+		while (b < nbuckets - 1 && retries >= (1L << b))
+			b++;
+		bump(c.calls, 1);
+		bump(c.retries, retries);
+		bump(c.histogram[b], 1);
+
+		slotcounters * s = p->lookup(slot, site);
+		if (s != nullptr) {
+			bump(s->calls, 1);
+			bump(s->retries, retries);
+		}
+		else
+			bump(p->untracked, 1);
+	}
+};
+
+//
+// probe for one call on slot, counts tries and records on exit
+//
+struct atomic_ptr_probe {
+	int				site;
+	const void *	slot;
+	long			tries;
+
+	atomic_ptr_probe(int s, const void * p) : site(s), slot(p), tries(0) {}
+	~atomic_ptr_probe() { atomic_ptr_stats::record(site, slot, (tries > 0) ? tries - 1 : 0); }
+};
+
+#define CASPROBE(site, slot) atomic_ptr_probe _probe(site, slot)
+#define CASTRY() (_probe.tries++)
+
+//
+// dump -- per kind totals, then the top slots by retries, summed over threads
+//
+inline void atomic_ptr_stats_dump(FILE * f = stderr, int top = 10) {
+	static const char * labels[atomic_ptr_stats::nbuckets] = { "0", "1", "2-3", "4-7", "8-15", "16-31", "32+" };
+	atomic_ptr_stats::counters total[atomic_ptr_nsites] = {};
+	std::vector<atomic_ptr_stats::slotcounters> slots;
+	long untracked = 0;
+
+	for (atomic_ptr_stats * p = atomic_load_explicit(&atomic_ptr_stats::head(), memory_order_acquire); p != nullptr; p = p->next) {
+		for (int j = 0; j < atomic_ptr_nsites; j++) {
+			atomic_ptr_stats::counters & c = p->site[j];
+			total[j].calls += atomic_load_explicit(&c.calls, memory_order_relaxed);
+			total[j].retries += atomic_load_explicit(&c.retries, memory_order_relaxed);
+			for (int k = 0; k < atomic_ptr_stats::nbuckets; k++)
+				total[j].histogram[k] += atomic_load_explicit(&c.histogram[k], memory_order_relaxed);
+		}
+		for (int j = 0; j < atomic_ptr_stats::nslots; j++) {
+			atomic_ptr_stats::slotcounters & s = p->slots[j];
+			atomic_ptr_stats::slotcounters x;
+			if ((x.slot = atomic_load_explicit(&s.slot, memory_order_acquire)) == nullptr)
+				continue;
+			x.site = s.site;
+			x.calls = atomic_load_explicit(&s.calls, memory_order_relaxed);
+			x.retries = atomic_load_explicit(&s.retries, memory_order_relaxed);
+			slots.push_back(x);
+		}
+		untracked += atomic_load_explicit(&p->untracked, memory_order_relaxed);
+	}
+
+	fprintf(f, "%-12s %12s %12s %8s  retries/call histogram\n", "site", "calls", "retries", "avg");
+	for (int j = 0; j < atomic_ptr_nsites; j++) {
+		if (total[j].calls == 0)
+			continue;
+		fprintf(f, "%-12s %12ld %12ld %8.4f ", atomic_ptr_stats::name(j), total[j].calls, total[j].retries,
+				(double)total[j].retries/(double)total[j].calls);
+		for (int k = 0; k < atomic_ptr_stats::nbuckets; k++) {
+			if (total[j].histogram[k] != 0)
+				fprintf(f, " %s:%ld", labels[k], total[j].histogram[k]);
+		}
+		fprintf(f, "\n");
+	}
+
+	// merge threads' entries for the same slot and site
+	std::sort(slots.begin(), slots.end(), [](const atomic_ptr_stats::slotcounters & a, const atomic_ptr_stats::slotcounters & b) {
+		return (a.slot != b.slot) ? (a.slot < b.slot) : (a.site < b.site);
+	});
+	size_t n = 0;
+	for (size_t j = 0; j < slots.size(); j++) {
+		if (n > 0 && slots[n - 1].slot == slots[j].slot && slots[n - 1].site == slots[j].site) {
+			slots[n - 1].calls += slots[j].calls;
+			slots[n - 1].retries += slots[j].retries;
+		}
+		else
+			slots[n++] = slots[j];
+	}
+	slots.resize(n);
+
+	std::sort(slots.begin(), slots.end(), [](const atomic_ptr_stats::slotcounters & a, const atomic_ptr_stats::slotcounters & b) {
+		return a.retries > b.retries;
+	});
+	if (slots.empty() || slots[0].retries == 0)
+		return;
+
+	fprintf(f, "%-18s %-12s %12s %12s %8s\n", "slot", "site", "calls", "retries", "avg");
+	for (size_t j = 0; j < slots.size() && j < (size_t)top && slots[j].retries > 0; j++) {
+		fprintf(f, "%-18p %-12s %12ld %12ld %8.4f\n", slots[j].slot, atomic_ptr_stats::name(slots[j].site),
+				slots[j].calls, slots[j].retries, (double)slots[j].retries/(double)slots[j].calls);
+	}
+	if (untracked != 0)
+		fprintf(f, "untracked slot calls = %ld\n", untracked);
+}
+
+// not synchronized w/ threads updating their counters
+inline void atomic_ptr_stats_reset() {
+	for (atomic_ptr_stats * p = atomic_load_explicit(&atomic_ptr_stats::head(), memory_order_acquire); p != nullptr; p = p->next) {
+		for (int j = 0; j < atomic_ptr_nsites; j++) {
+			atomic_ptr_stats::counters & c = p->site[j];
+			atomic_store_explicit(&c.calls, 0L, memory_order_relaxed);
+			atomic_store_explicit(&c.retries, 0L, memory_order_relaxed);
+			for (int k = 0; k < atomic_ptr_stats::nbuckets; k++)
+				atomic_store_explicit(&c.histogram[k], 0L, memory_order_relaxed);
+		}
+		for (int j = 0; j < atomic_ptr_stats::nslots; j++) {
+			atomic_ptr_stats::slotcounters & s = p->slots[j];
+			atomic_store_explicit(&s.calls, 0L, memory_order_relaxed);
+			atomic_store_explicit(&s.retries, 0L, memory_order_relaxed);
+			atomic_store_explicit(&s.slot, (const void *)nullptr, memory_order_relaxed);
+		}
+		atomic_store_explicit(&p->untracked, 0L, memory_order_relaxed);
+	}
+}
+#else
+#define CASPROBE(site, slot) ((void)(site), (void)(slot))	// unused w/o stats
+#define CASTRY()
+
+inline void atomic_ptr_stats_dump(void * = nullptr, int = 0) {}
+inline void atomic_ptr_stats_reset() {}
+#endif
+
+//
+// bounded exponential backoff for CAS retry loops.  Spins double up
+// to maxspin, after which each backoff yields the processor.
+//
+struct atomic_ptr_backoff {
+	static const int maxspin = 1024;
+	int		spin;
+
+	atomic_ptr_backoff() : spin(1) {}
+
+	void operator () () {
+		if (spin > maxspin) {
+			sched_yield();
+			return;
+		}
+		for (int j = 0; j < spin; j++) {
+#if defined(__i386__) || defined(__x86_64__)
+			__builtin_ia32_pause();
+#else
+			atomic_signal_fence(memory_order_seq_cst);
+#endif
+		}
+		spin <<= 1;
+	}
+};
+
+//
+// wait/notify for atomic_ptr value changes.  Waiters block on a futex
+// event count in a small hashed table keyed by atomic_ptr address, so
+// atomic_ptr stays two words and notify is a load when nobody waits.
+// Elsewhere waiters poll w/ sched_yield.
+//
+// A bucket is shared by every atomic_ptr that hashes to it, so notify
+// wakes all of the bucket's waiters, even for notify_one.  Waking just
+// one could pick a waiter on another atomic_ptr, which goes back to
+// sleep, and the notify would be lost.  Waiters on other atomic_ptrs
+// recheck their values and block again.
+//
+struct atomic_ptr_waitq {
+	static const int nbuckets = 64;
+
+	struct alignas(64) bucket {
+		int		event;			// futex word, bumped by notify
+		long	waiters;		// # blocked or about to block
+	};
+
+	static bucket & get(void * addr) {
+		static bucket table[nbuckets];
+		return table[((uintptr_t)addr >> 4) % nbuckets];
+	}
+
+	// call before rechecking the value
+	static int prepare(bucket & b) {
+		atomic_fetch_add_explicit(&b.waiters, 1, memory_order_seq_cst);
+		atomic_thread_fence(memory_order_seq_cst);
+		return atomic_load_explicit(&b.event, memory_order_acquire);
+	}
+
+	static void wait(bucket & b, int event) {
+#ifdef __linux__
+		syscall(SYS_futex, &b.event, FUTEX_WAIT_PRIVATE, event, NULL, NULL, 0);
+#else
+		sched_yield();
+#endif
+		atomic_fetch_sub_explicit(&b.waiters, 1, memory_order_relaxed);
+	}
+
+	static void cancel(bucket & b) {
+		atomic_fetch_sub_explicit(&b.waiters, 1, memory_order_relaxed);
+	}
+
+	// call after storing the new value, wakes every waiter on the bucket
+	static void notify(void * addr) {
+		bucket & b = get(addr);
+
+		atomic_thread_fence(memory_order_seq_cst);
+		if (atomic_load_explicit(&b.waiters, memory_order_relaxed) == 0)
+			return;
+		atomic_fetch_add_explicit(&b.event, 1, memory_order_release);
+#ifdef __linux__
+		syscall(SYS_futex, &b.event, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+#endif
+	}
+};
 
 
 //=============================================================================
@@ -103,32 +546,98 @@ typedef void (*pool_put_t)(void *);
 //
 //=============================================================================
 template<typename T> class atomic_ptr_ref {
-	friend class atomic_ptr<T>;
+	template<typename, template<typename> class, typename> friend class atomic_ptr;
 	friend class local_ptr<T>;
+	friend class atomic_ptr_block<T>;
+	template<typename, typename, typename> friend class atomic_ptr_deleter_ref;
+	template<typename, typename> friend class atomic_ptr_alloc_block;
+	friend class atomic_ptr_smr_block<T>;
+	friend class distributed_atomic_ptr_ref<T>;
+	friend struct packedReference<T>;
+	friend struct differentialReference<T>;
+	template<typename, template<typename> class, typename> friend class atomic_ptr_guard;
+	friend class local_weak_ptr<T>;
+	friend class atomic_weak_ptr<T>;
+
+	public:
+		//
+		// object destruction and ref deallocation for each kind of ref,
+		// plain (delete), atomic_ptr_block, custom deleter or allocator
+		//
+		struct ops_t {
+			void	(*destroy)(atomic_ptr_ref<T> *, T *);	// destroy object
+			void	(*release)(atomic_ptr_ref<T> *);		// free ref storage
+		};
 
 	private:
 		refcount	count;				// reference counts
+		refcount	wcount;				// weak reference counts
 		T *			ptr;				// ptr to actual object
 		pool_put_t	pool;
+		const ops_t * ops;
+		bool		weak;				// weak references have been created
+
+		static const ops_t deleteOps;
+
+		static void deleteObject(atomic_ptr_ref<T> *, T * obj) { delete obj; }
+		static void deleteRef(atomic_ptr_ref<T> * ref) { delete ref; }
 
 	public:
 		atomic_ptr_ref<T> * next;
 
 
 		atomic_ptr_ref(T * p = nullptr) {
-			count.ecount = 0;
-			count.rcount = 1;
+			count.set(0, 1);
+			wcount.set(0, 1);			// held by the strong references
 			ptr = p;
 			pool = nullptr;
+			ops = &deleteOps;
+			weak = false;
 			next = nullptr;
 		};
 
+	private:
+
+		//----------------------------------------------------------------------
+		// dispose -- recycle to pool or delete ref w/ zero refcounts
+		//
+		// The object is destroyed here but the ref's storage is kept
+		// until the weak refcounts also go to zero.  weak is set before
+		// the first weak reference is created, by a thread holding a
+		// reference, so it's visible here after the acquire membar of
+		// the last adjust.
+		//----------------------------------------------------------------------
+		void dispose() {
+			if (pool != nullptr)
+				pool(this);					// recycle to pool
+			else {
+				destroy();
+				if (!weak || adjustWeak(0, -1) == 0)
+					release();
+			}
+		}
+
+		// destroy object
+		void destroy() {
+			T * temp = ptr;
+			atomic_store_explicit(&ptr, (T *)nullptr, memory_order_relaxed);
+			ops->destroy(this, temp);
+		}
 
-		~atomic_ptr_ref() {
-			delete ptr;
+		// free ref storage, object already destroyed
+		void release() {
+			ops->release(this);
 		}
 
-	private:
+		// drop n ephemeral references deferred by local_ptr_batch
+		static void dropBatched(void * ref, long n) {
+			atomic_ptr_ref<T> * refptr = (atomic_ptr_ref<T> *)ref;
+
+			if (refptr->adjust_mb(-n, 0, memory_order_release) == 0) {
+				atomic_thread_fence(memory_order_acquire);
+				refptr->dispose();
+			}
+		}
 
 		//----------------------------------------------------------------------
 		// adjust -- adjust refcounts
@@ -142,37 +651,587 @@ template<typename T> class atomic_ptr_ref {
 		// Adding references does not require membars.
 		//----------------------------------------------------------------------
 		int adjust_mb(long xephemeralCount, long xreferenceCount) {
+			return adjustCount(count, xephemeralCount, xreferenceCount, memory_order_acq_rel, site_adjust_mb);
+		}
+
+		int adjust_mb(long xephemeralCount, long xreferenceCount, memory_order mo) {
+			return adjustCount(count, xephemeralCount, xreferenceCount, mo, site_adjust_mb);
+		}
+
+		//----------------------------------------------------------------------
+		// adjust refcount w/o membar
+		//----------------------------------------------------------------------
+		int adjust(long xephemeralCount, long xreferenceCount) {
+			return adjustCount(count, xephemeralCount, xreferenceCount, memory_order_relaxed, site_adjust);
+		}
+
+		//----------------------------------------------------------------------
+		// adjust weak refcount.  Always w/ membar since the storage is
+		// freed when the weak counts go to zero.
+		//----------------------------------------------------------------------
+		int adjustWeak(long xephemeralCount, long xreferenceCount) {
+			return adjustCount(wcount, xephemeralCount, xreferenceCount, memory_order_acq_rel, site_adjust_weak);
+		}
+
+#ifdef ATOMIC_PTR_PACKED_REFCOUNT
+		int adjustCount(refcount & c, long xephemeralCount, long xreferenceCount, memory_order mo, int site) {
+			int64_t delta = refcount::pack(xephemeralCount, xreferenceCount);
+			CASPROBE(site, this);
+
+			CASCOUNT(); CASTRY();
+			return (atomic_fetch_add_explicit(&c.val, delta, mo) + delta == 0) ? 0 : 1;
+		}
+#else
+		int adjustCount(refcount & c, long xephemeralCount, long xreferenceCount, memory_order mo, int site) {
 			refcount oldval, newval;
+			CASPROBE(site, this);
 
-			oldval.ecount = count.ecount;
-			oldval.rcount = count.rcount;
+			oldval.ecount = c.ecount;
+			oldval.rcount = c.rcount;
 			do {
+				CASCOUNT(); CASTRY();
 				newval.ecount = oldval.ecount + xephemeralCount;
 				newval.rcount = oldval.rcount + xreferenceCount;
 			}
-			while (!atomic_compare_exchange_strong_explicit((ival*)&count, (ival*)&oldval, (ival)newval, memory_order_acq_rel, memory_order_relaxed));
+			while (!atomic_ptr_dwcas(&c, &oldval, &newval, mo, memory_order_relaxed));
 
 			return (newval.ecount == 0 && newval.rcount == 0) ? 0 : 1;
 		}
+#endif
 
 		//----------------------------------------------------------------------
-		// adjust refcount w/o membar
+		// transfer -- convert an ephemeral reference into a link reference
+		//
+		// If the caller holds the only reference no other thread can
+		// acquire one, so the counts can be set w/o an interlocked
+		// instruction.  Visibility is provided by the release membar
+		// of the store into the atomic_ptr.
 		//----------------------------------------------------------------------
-		int adjust(long xephemeralCount, long xreferenceCount) {
+		void transfer(bool unique) {
+			if (unique) {
+				count.set(0, 1);
+			}
+			else
+				adjust(-1, +1);
+		}
+
+		//----------------------------------------------------------------------
+		// tryacquire -- add ephemeral reference unless counts are zero
+		//
+		// Caller must guarantee the ref is not freed, e.g. w/ a hazard
+		// pointer.  Counts that have gone to zero stay zero.  An apparent
+		// zero is confirmed w/ a CAS so a torn read can't cause a failure.
+		//----------------------------------------------------------------------
+#ifdef ATOMIC_PTR_PACKED_REFCOUNT
+		bool tryacquire() {
+			int64_t oldval = atomic_load_explicit(&count.val, memory_order_relaxed);
+			CASPROBE(site_tryacquire, this);
+
+			while (oldval != 0) {
+				CASCOUNT(); CASTRY();
+				if (atomic_compare_exchange_strong_explicit(&count.val, &oldval, oldval + refcount::pack(1, 0), memory_order_relaxed, memory_order_relaxed))
+					return true;
+			}
+
+			return false;
+		}
+#else
+		bool tryacquire() {
 			refcount oldval, newval;
 
+			CASPROBE(site_tryacquire, this);
+
 			oldval.ecount = count.ecount;
 			oldval.rcount = count.rcount;
+			for (;;) {
+				CASCOUNT(); CASTRY();
+				if (oldval.ecount == 0 && oldval.rcount == 0) {
+					newval = oldval;
+					if (atomic_ptr_dwcas(&count, &oldval, &newval, memory_order_relaxed, memory_order_relaxed))
+						return false;
+				}
+				else {
+					newval.ecount = oldval.ecount + 1;
+					newval.rcount = oldval.rcount;
+					if (atomic_ptr_dwcas(&count, &oldval, &newval, memory_order_relaxed, memory_order_relaxed))
+						return true;
+				}
+			}
+		}
+#endif
+
+}; // class atomic_ptr_ref
+
+template<typename T> const typename atomic_ptr_ref<T>::ops_t atomic_ptr_ref<T>::deleteOps = {
+	&atomic_ptr_ref<T>::deleteObject,
+	&atomic_ptr_ref<T>::deleteRef
+};
+
+
+//
+// destroy object allocated in place, nothing for trivially destructible T
+//
+template<typename T> inline void atomic_ptr_destroy_inplace(T *, std::true_type) {}
+template<typename T> inline void atomic_ptr_destroy_inplace(T * obj, std::false_type) { obj->~T(); }
+
+template<typename T> inline void atomic_ptr_destroy_inplace(atomic_ptr_ref<T> *, T * obj) {
+	atomic_ptr_destroy_inplace(obj, typename std::is_trivially_destructible<T>::type());
+}
+
+
+//=============================================================================
+// atomic_ptr_block -- atomic_ptr_ref w/ object allocated in the same block
+//
+// Used by make_local/make_atomic.  One allocation per object and the
+// object shares cache lines with its reference counts.  If recycled
+// to a pool, the object is recycled along with the ref.
+//=============================================================================
+template<typename T> class atomic_ptr_block : public atomic_ptr_ref<T> {
+	public:
+		template<typename... Args> atomic_ptr_block(Args&&... args) : atomic_ptr_ref<T>(nullptr) {
+			this->ptr = new (&storage) T(std::forward<Args>(args)...);
+			this->ops = &blockOps;
+		}
+
+	private:
+		typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+
+		static const typename atomic_ptr_ref<T>::ops_t blockOps;
+
+		static void deleteBlock(atomic_ptr_ref<T> * ref) {
+			delete static_cast<atomic_ptr_block<T> *>(ref);
+		}
+
+}; // class atomic_ptr_block
+
+template<typename T> const typename atomic_ptr_ref<T>::ops_t atomic_ptr_block<T>::blockOps = {
+	&atomic_ptr_destroy_inplace<T>,
+	&atomic_ptr_block<T>::deleteBlock
+};
+
+
+//=============================================================================
+// atomic_ptr_deleter_ref -- atomic_ptr_ref w/ custom deleter and allocator
+//
+// The object is destroyed w/ deleter D and the ref itself is allocated
+// w/ allocator A (rebound to the ref type).  Created by the local_ptr
+// deleter/allocator constructors.
+//=============================================================================
+template<typename T, typename D, typename A> class atomic_ptr_deleter_ref : public atomic_ptr_ref<T> {
+	typedef typename std::allocator_traits<A>::template rebind_alloc<atomic_ptr_deleter_ref> alloc_t;
+	typedef std::allocator_traits<alloc_t> traits;
+
+	public:
+		static atomic_ptr_ref<T> * create(T * obj, D deleter, const A & a) {
+			alloc_t alloc(a);
+			atomic_ptr_deleter_ref * ref;
+
+			try {
+				ref = traits::allocate(alloc, 1);
+			}
+			catch (...) {
+				deleter(obj);
+				throw;
+			}
+			::new ((void *)ref) atomic_ptr_deleter_ref(obj, std::move(deleter), alloc);
+			return ref;
+		}
+
+	private:
+		D		deleter;
+		alloc_t	alloc;
+
+		atomic_ptr_deleter_ref(T * obj, D && d, const alloc_t & a) : atomic_ptr_ref<T>(obj), deleter(std::move(d)), alloc(a) {
+			this->ops = &deleterOps;
+		}
+
+		static const typename atomic_ptr_ref<T>::ops_t deleterOps;
+
+		static void deleteObject(atomic_ptr_ref<T> * ref, T * obj) {
+			static_cast<atomic_ptr_deleter_ref *>(ref)->deleter(obj);
+		}
+
+		static void deallocateRef(atomic_ptr_ref<T> * ref) {
+			atomic_ptr_deleter_ref * temp = static_cast<atomic_ptr_deleter_ref *>(ref);
+			alloc_t alloc(std::move(temp->alloc));
+
+			temp->~atomic_ptr_deleter_ref();
+			traits::deallocate(alloc, temp, 1);
+		}
+
+}; // class atomic_ptr_deleter_ref
+
+template<typename T, typename D, typename A> const typename atomic_ptr_ref<T>::ops_t atomic_ptr_deleter_ref<T, D, A>::deleterOps = {
+	&atomic_ptr_deleter_ref<T, D, A>::deleteObject,
+	&atomic_ptr_deleter_ref<T, D, A>::deallocateRef
+};
+
+
+//=============================================================================
+// atomic_ptr_alloc_block -- atomic_ptr_block allocated w/ allocator A
+//
+// Used by allocate_local.
+//=============================================================================
+template<typename T, typename A> class atomic_ptr_alloc_block : public atomic_ptr_ref<T> {
+	typedef typename std::allocator_traits<A>::template rebind_alloc<atomic_ptr_alloc_block> alloc_t;
+	typedef std::allocator_traits<alloc_t> traits;
+
+	public:
+		template<typename... Args> static atomic_ptr_ref<T> * create(const A & a, Args&&... args) {
+			alloc_t alloc(a);
+			atomic_ptr_alloc_block * ref = traits::allocate(alloc, 1);
+
+			try {
+				::new ((void *)ref) atomic_ptr_alloc_block(alloc, std::forward<Args>(args)...);
+			}
+			catch (...) {
+				traits::deallocate(alloc, ref, 1);
+				throw;
+			}
+			return ref;
+		}
+
+	private:
+		alloc_t	alloc;
+		typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+
+		template<typename... Args> atomic_ptr_alloc_block(const alloc_t & a, Args&&... args) : atomic_ptr_ref<T>(nullptr), alloc(a) {
+			this->ptr = new (&storage) T(std::forward<Args>(args)...);
+			this->ops = &allocOps;
+		}
+
+		static const typename atomic_ptr_ref<T>::ops_t allocOps;
+
+		static void deallocateBlock(atomic_ptr_ref<T> * ref) {
+			atomic_ptr_alloc_block * temp = static_cast<atomic_ptr_alloc_block *>(ref);
+			alloc_t alloc(std::move(temp->alloc));
+
+			temp->~atomic_ptr_alloc_block();
+			traits::deallocate(alloc, temp, 1);
+		}
+
+}; // class atomic_ptr_alloc_block
+
+template<typename T, typename A> const typename atomic_ptr_ref<T>::ops_t atomic_ptr_alloc_block<T, A>::allocOps = {
+	&atomic_ptr_destroy_inplace<T>,
+	&atomic_ptr_alloc_block<T, A>::deallocateBlock
+};
+
+
+//
+// deleter for arrays allocated w/ new T[n]
+//
+template<typename T> struct atomic_ptr_delete_array {
+	void operator () (T * obj) const { delete[] obj; }
+};
+
+
+//=============================================================================
+// atomic_ptr reference representations
+//
+// An atomic_ptr holds a differential reference, a pointer to the
+// atomic_ptr_ref plus an ephemeral count of the references acquired
+// through it.  The ephemeral count is added to the atomic_ptr_ref
+// refcount when the atomic_ptr is swapped out.  The representation
+// is selected by atomic_ptr's second template parameter.
+//
+//   getptr, getecount, init -- non-atomic, for local non-shared copies
+//   peek      -- atomically load ptr w/o acquiring a reference
+//   acquire   -- atomically increment ephemeral count and return ptr
+//   exchange  -- atomically swap w/ local non-shared copy
+//   cas       -- atomically replace if ptr == cmp
+//=============================================================================
+
+//
+// Differential reference in a double word, updated w/ double wide CAS.
+//
+template<typename T> struct alignas(sizeof(ival)) differentialReference {
+	long	ecount; // ephemeral count
+	atomic_ptr_ref<T> *ptr;
+
+	atomic_ptr_ref<T> * getptr() { return ptr; }
+	long getecount() { return ecount; }
+
+	void init(atomic_ptr_ref<T> * src) {
+		ecount = 0;
+		ptr = src;
+	}
+
+	atomic_ptr_ref<T> * peek(memory_order mo = memory_order_acquire) {
+		return atomic_load_explicit(&ptr, mo);
+	}
+
+	atomic_ptr_ref<T> * acquire(memory_order mo = memory_order_acquire) {
+		differentialReference<T> oldval, newval;
+
+		{
+			CASPROBE(site_acquire, this);
+
+			oldval.ecount = ecount;
+			oldval.ptr = ptr;
+
 			do {
-				newval.ecount = oldval.ecount + xephemeralCount;
-				newval.rcount = oldval.rcount + xreferenceCount;
+				CASCOUNT(); CASTRY();
+				newval.ecount = oldval.ecount + 1;
+				newval.ptr = oldval.ptr;
+			}
+			while (!atomic_ptr_dwcas(this, &oldval, &newval, mo, memory_order_relaxed));
+		}
+#ifdef ATOMIC_PTR_PACKED_REFCOUNT
+		if (oldval.ecount >= threshold)
+			transfer(oldval.ptr);
+#endif
+
+		return oldval.ptr;
+	}
+
+	void exchange(differentialReference<T> & obj, memory_order mo = memory_order_release) {
+		/*
+		differentialReference<T> temp;
+
+		temp.ecount = ecount;
+		temp.ptr = ptr;
+
+		while(!atomic_compare_exchange_strong_explicit(this, &temp, obj, memory_order_release, memory_order_relaxed));
+
+		obj.ecount = temp.ecount;
+		obj.ptr = temp.ptr;
+		*/
+		differentialReference<T> temp;
+		CASPROBE(site_exchange, this);
+		CASCOUNT(); CASTRY();
+		atomic_ptr_dwexchange(this, &obj, &temp, mo);
+		obj = temp;
+	}
+
+	bool cas(atomic_ptr_ref<T> * cmp, differentialReference<T> & xchg) {
+		differentialReference<T> temp;
+		CASPROBE(site_cas, this);
+
+		temp.ecount = ecount;
+		temp.ptr = cmp;
+
+		do {
+			CASCOUNT(); CASTRY();
+			if (atomic_ptr_dwcas(this, &temp, &xchg, memory_order_acq_rel, memory_order_relaxed)) {
+				xchg = temp;
+				return true;
 			}
-			while (!atomic_compare_exchange_strong_explicit((ival*)&count, (ival*)&oldval, (ival)newval, memory_order_relaxed, memory_order_relaxed));
 
-			return (newval.ecount == 0 && newval.rcount == 0) ? 0 : 1;
+		}
+		while (cmp == temp.ptr);
+
+		return false;
+	}
+
+#ifdef ATOMIC_PTR_PACKED_REFCOUNT
+	static const long threshold = 1L << 24;	// transfer count, keeps ref's 32 bit ecount in range
+
+	//----------------------------------------------------------------------
+	// transfer -- move threshold ephemeral counts into the refcount, only
+	// needed w/ the packed 32 bit refcount.  Same protocol as
+	// packedReference::transfer.
+	//----------------------------------------------------------------------
+	void transfer(atomic_ptr_ref<T> * ref) {
+		differentialReference<T> temp, newval;
+
+		if (ref != nullptr)
+			ref->adjust(threshold, 0);
+
+		{
+			CASPROBE(site_transfer, this);
+			temp.ecount = ecount;
+			temp.ptr = ptr;
+			while (temp.ptr == ref && temp.ecount >= threshold) {
+				CASCOUNT(); CASTRY();
+				newval.ecount = temp.ecount - threshold;
+				newval.ptr = temp.ptr;
+				if (atomic_ptr_dwcas(this, &temp, &newval, memory_order_relaxed, memory_order_relaxed))
+					return;
+			}
 		}
 
-}; // class atomic_ptr_ref
+		if (ref != nullptr)
+			ref->adjust(-threshold, 0);
+	}
+#endif
+};
+
+//
+// Packed differential reference in a single word, ephemeral count in
+// the upper 16 bits of the pointer.  Requires 48 bit virtual addresses.
+// acquire is a single fetch_add.  Before the count overflows, a reader
+// moves part of it into the atomic_ptr_ref refcount.
+//
+template<typename T> struct packedReference {
+	uintptr_t	val;	// ecount << shift | ptr
+
+	static const int shift = 48;
+	static const uintptr_t one = (uintptr_t)1 << shift;
+	static const uintptr_t mask = one - 1;
+	static const long threshold = 1 << 14;	// transfer count, 1/4 of max count
+
+	static_assert(sizeof(uintptr_t) == 8, "packedReference requires 64 bit pointers");
+
+	atomic_ptr_ref<T> * getptr() { return (atomic_ptr_ref<T> *)(val & mask); }
+	long getecount() { return (long)(val >> shift); }
+
+	void init(atomic_ptr_ref<T> * src) {
+		val = (uintptr_t)src;
+	}
+
+	atomic_ptr_ref<T> * peek(memory_order mo = memory_order_acquire) {
+		return (atomic_ptr_ref<T> *)(atomic_load_explicit(&val, mo) & mask);
+	}
+
+	atomic_ptr_ref<T> * acquire(memory_order mo = memory_order_acquire) {
+		uintptr_t oldval;
+
+		{
+			CASPROBE(site_acquire, this);
+			CASCOUNT(); CASTRY();
+			oldval = atomic_fetch_add_explicit(&val, one, mo);
+		}
+		if ((long)(oldval >> shift) >= threshold)
+			transfer((atomic_ptr_ref<T> *)(oldval & mask));
+
+		return (atomic_ptr_ref<T> *)(oldval & mask);
+	}
+
+	void exchange(packedReference<T> & obj, memory_order mo = memory_order_release) {
+		CASPROBE(site_exchange, this);
+		CASCOUNT(); CASTRY();
+		obj.val = atomic_exchange_explicit(&val, obj.val, mo);
+	}
+
+	bool cas(atomic_ptr_ref<T> * cmp, packedReference<T> & xchg) {
+		uintptr_t temp;
+		CASPROBE(site_cas, this);
+
+		temp = atomic_load_explicit(&val, memory_order_relaxed);
+
+		while ((temp & mask) == (uintptr_t)cmp) {
+			CASCOUNT(); CASTRY();
+			if (atomic_compare_exchange_strong_explicit(&val, &temp, xchg.val, memory_order_acq_rel, memory_order_relaxed)) {
+				xchg.val = temp;
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	//----------------------------------------------------------------------
+	// transfer -- move threshold ephemeral counts into the refcount
+	//
+	// The refcount is raised first so the total never undercounts.  If
+	// the slot no longer holds the ref or another reader already did
+	// the transfer, the adjustment is backed out.  The caller holds an
+	// ephemeral reference so the refcount cannot go to zero.  Counts on
+	// a null ptr are not tracked and are simply dropped.
+	//----------------------------------------------------------------------
+	void transfer(atomic_ptr_ref<T> * ref) {
+		uintptr_t temp;
+
+		if (ref != nullptr)
+			ref->adjust(threshold, 0);
+
+		{
+			CASPROBE(site_transfer, this);
+			temp = atomic_load_explicit(&val, memory_order_relaxed);
+			while ((temp & mask) == (uintptr_t)ref && (long)(temp >> shift) >= threshold) {
+				CASCOUNT(); CASTRY();
+				if (atomic_compare_exchange_strong_explicit(&val, &temp, temp - threshold * one, memory_order_relaxed, memory_order_relaxed))
+					return;
+			}
+		}
+
+		if (ref != nullptr)
+			ref->adjust(-threshold, 0);
+	}
+};
+
+
+//=============================================================================
+// local_ptr_batch -- defer local_ptr reference drops for a scope
+//
+// While a local_ptr_batch is live in a thread, ~local_ptr records the
+// drop in a small thread local buffer instead of adjusting the refcount.
+// Drops of the same atomic_ptr_ref are coalesced into one adjust when the
+// buffer is flushed, at exit from the outermost scope or when the buffer
+// is full.  Objects live until the flush.
+//
+//=============================================================================
+class local_ptr_batch {
+	template<typename> friend class local_ptr;
+	public:
+		static const int size = 32;			// refs per buffer
+
+		local_ptr_batch() { state().depth++; }
+
+		~local_ptr_batch() {
+			batch_t & b = state();
+			if (--b.depth == 0)
+				flush(b);
+		}
+
+		static void flush() { flush(state()); }
+
+	private:
+		void * operator new (size_t);		// auto only
+		local_ptr_batch(const local_ptr_batch &);
+		local_ptr_batch & operator = (const local_ptr_batch &);
+
+		struct entry {
+			void *	ref;
+			long	count;					// deferred drops
+			void	(*drop)(void *, long);
+		};
+
+		struct batch_t {
+			int		depth;					// # live scopes
+			int		n;						// # entries
+			entry	e[size];
+		};
+
+		static batch_t & state() {
+			static thread_local batch_t b = {0, 0, {}};
+			return b;
+		}
+
+		// record drop, false if no batch scope is live
+		static bool defer(void * ref, void (*drop)(void *, long)) {
+			batch_t & b = state();
+
+			if (b.depth == 0)
+				return false;
+
+			for (int j = b.n - 1; j >= 0; j--) {
+				if (b.e[j].ref == ref) {
+					b.e[j].count++;
+					return true;
+				}
+			}
+
+			if (b.n == size)
+				flush(b);
+			b.e[b.n].ref = ref;
+			b.e[b.n].count = 1;
+			b.e[b.n].drop = drop;
+			b.n++;
+			return true;
+		}
+
+		// entries are popped one at a time since dropping a ref can run
+		// destructors that defer more drops
+		static void flush(batch_t & b) {
+			while (b.n > 0) {
+				entry e = b.e[--b.n];
+				e.drop(e.ref, e.count);
+			}
+		}
+
+}; // class local_ptr_batch
 
 
 //=============================================================================
@@ -181,44 +1240,68 @@ template<typename T> class atomic_ptr_ref {
 //
 //=============================================================================
 template<typename T> class local_ptr {
-	friend class atomic_ptr<T>;
+	template<typename, template<typename> class, typename> friend class atomic_ptr;
+	template<typename, template<typename> class, typename> friend class atomic_ptr_guard;
+	friend class distributed_atomic_ptr_ref<T>;
+	friend class local_weak_ptr<T>;
+	friend class atomic_weak_ptr<T>;
 	public:
 
 		local_ptr(T * obj = nullptr) {
 			if (obj != nullptr) {
 				refptr = new atomic_ptr_ref<T>(obj);
-				refptr->count.ecount = 1;
-				refptr->count.rcount = 0;
+				refptr->count.set(1, 0);
+			}
+			else
+				refptr = nullptr;
+			unique = true;
+		}
+
+		// obj destroyed w/ deleter, ref allocated w/ alloc
+		template<typename D, typename A = std::allocator<T>> local_ptr(T * obj, D deleter, const A & alloc = A()) {
+			if (obj != nullptr) {
+				refptr = atomic_ptr_deleter_ref<T, D, A>::create(obj, std::move(deleter), alloc);
+				refptr->count.set(1, 0);
 			}
 			else
 				refptr = nullptr;
+			unique = true;
 		}
 
 		local_ptr(const local_ptr<T> & src) {
 			if ((refptr = src.refptr) != 0)
 				refptr->adjust(+1, 0);
+			unique = false;
+			src.unique = false;
+		}
+
+		local_ptr(local_ptr<T> && src) {	// move constructor
+			refptr = src.refptr;
+			unique = src.unique;
+			src.refptr = nullptr;
 		}
 
-		local_ptr(atomic_ptr<T> & src) {
+		template<template<typename> class R, typename O> local_ptr(atomic_ptr<T, R, O> & src) {
 			refptr = src.getrefptr();
+			unique = false;
 		}
 
 		// recycled ref object
 		local_ptr(atomic_ptr_ref<T>  * src) {
 			refptr = src;
 			if (refptr != nullptr) {
-				refptr->count.ecount = 1;
-				refptr->count.rcount = 0;
+				refptr->count.set(1, 0);
 			}
+			unique = true;
 			// pool unchanged
 		}
 
 		~local_ptr() {
-			if (refptr != nullptr && refptr->adjust_mb(-1, 0) == 0) {
-				if (refptr->pool == nullptr)
-					delete refptr;
-				else
-					refptr->pool(refptr);		// recyle to pool
+			if (refptr == nullptr || local_ptr_batch::defer(refptr, &atomic_ptr_ref<T>::dropBatched))
+				return;
+			if (refptr->adjust_mb(-1, 0, memory_order_release) == 0) {
+				atomic_thread_fence(memory_order_acquire);
+				refptr->dispose();
 			}
 		}
 		
@@ -234,7 +1317,13 @@ template<typename T> class local_ptr {
 			return *this;
 		}
 
-		local_ptr<T> & operator = (atomic_ptr<T> & src) {
+		local_ptr<T> & operator = (local_ptr<T> && src) {
+			local_ptr<T> temp(std::move(src));
+			swap(temp);	// non-atomic
+			return *this;
+		}
+
+		template<template<typename> class R, typename O> local_ptr<T> & operator = (atomic_ptr<T, R, O> & src) {
 			local_ptr<T> temp(src);
 			swap(temp);	// non-atomic
 			return *this;
@@ -242,12 +1331,30 @@ template<typename T> class local_ptr {
 
 
 		T * get() {
-			return (refptr != nullptr) ? atomic_load_explicit(&refptr->ptr, MEMBAR1) : (T *)nullptr;
+			return (refptr != nullptr) ? atomic_load_explicit(&refptr->ptr, memory_order_relaxed) : (T *)nullptr;
 		}
 
 		T * operator -> () { return get(); }
 		T & operator * () { return *get(); }
+		T & operator [] (size_t ndx) { return get()[ndx]; }		// w/ atomic_ptr_delete_array
 		//operator T* () { return  get(); }
+		explicit operator bool () { return (refptr != nullptr); }
+
+		void reset() {
+			local_ptr<T> temp;
+			swap(temp);	// non-atomic
+		}
+
+		inline void swap(local_ptr & other) { // non-atomic swap
+			atomic_ptr_ref<T> * temp;
+			temp = refptr;
+			refptr = other.refptr;
+			other.refptr = temp;
+
+			bool utemp = unique;
+			unique = other.unique;
+			other.unique = utemp;
+		}
 
 		bool operator == (T * rhd) { return (rhd == get() ); }
 		bool operator != (T * rhd) { return (rhd != get() ); }
@@ -255,8 +1362,8 @@ template<typename T> class local_ptr {
 		// refptr == rhd.refptr  iff  refptr->ptr == rhd.refptr->ptr
 		bool operator == (local_ptr<T> & rhd) { return (refptr == rhd.refptr);}
 		bool operator != (local_ptr<T> & rhd) { return (refptr != rhd.refptr);}
-		bool operator == (atomic_ptr<T> & rhd) { return (refptr == rhd.ref.ptr);}
-		bool operator != (atomic_ptr<T> & rhd) { return (refptr != rhd.ref.ptr);}
+		template<template<typename> class R, typename O> bool operator == (atomic_ptr<T, R, O> & rhd) { return (refptr == rhd.ref.getptr());}
+		template<template<typename> class R, typename O> bool operator != (atomic_ptr<T, R, O> & rhd) { return (refptr != rhd.ref.getptr());}
 
 		//-----------------------------------------------------------------
 		// set/get recycle pool methods
@@ -281,12 +1388,12 @@ template<typename T> class local_ptr {
 		void * operator new (size_t) {}		// auto only
 
 		atomic_ptr_ref<T> * refptr;
+		mutable bool unique;			// only reference to refptr
 
-		inline void swap(local_ptr & other) { // non-atomic swap
-			atomic_ptr_ref<T> * temp;
-			temp = refptr;
-			refptr = other.refptr;
-			other.refptr = temp;
+		// adopt reference w/o adjusting refcount
+		inline void adopt(atomic_ptr_ref<T> * src) {
+			refptr = src;
+			unique = false;
 		}
 
 
@@ -311,78 +1418,212 @@ template<typename T> inline bool operator != (T * lhd, local_ptr<T> & rhd)
 //
 //
 //=============================================================================
-template<typename T> class atomic_ptr {
+template<typename T, template<typename> class R, typename O> class atomic_ptr {
 	friend class local_ptr<T>;
+	template<typename, template<typename> class, typename> friend class atomic_ptr;
+	friend class atomic_ptr_guard<T, R, O>;
 
 	protected:
-		differentialReference<T>  ref;
+		R<T>  ref;
+#ifdef ATOMIC_PTR_UPDATE_STATS
+		long	attempts = 0;	// update attempts
+		long	failures = 0;	// update cas failures
+#endif
 
 	public:
+		typedef atomic_ptr_guard<T, R, O> read_guard;	// see atomic_ptr_smr.h
 
 		atomic_ptr(T * obj = nullptr) {
-			ref.ecount = 0;
 			if (obj != nullptr) {
-				ref.ptr = new atomic_ptr_ref<T>(obj);
+				ref.init(new atomic_ptr_ref<T>(obj));
 			}
 			else
-				ref.ptr = nullptr;
+				ref.init(nullptr);
 		}
 
 		atomic_ptr(local_ptr<T> & src) {	// copy constructor
-			ref.ecount = 0;
-			if ((ref.ptr = src.refptr) != nullptr)
-				ref.ptr->adjust(0, +1);
+			ref.init(src.refptr);
+			if (src.refptr != nullptr)
+				src.refptr->adjust(0, +1);
+			src.unique = false;
+		}
+
+		atomic_ptr(local_ptr<T> && src) {	// move constructor
+			ref.init(src.refptr);
+			if (src.refptr != nullptr)
+				src.refptr->transfer(src.unique);
+			src.refptr = nullptr;
 		}
 
-		atomic_ptr(atomic_ptr<T> & src) {  // copy constructor
-			ref.ecount = 0;
-			ref.ptr = src.getrefptr();	// atomic 
+		atomic_ptr(atomic_ptr<T, R, O> & src) {  // copy constructor
+			atomic_ptr_ref<T> * refptr;
+
+			refptr = src.getrefptr();	// atomic 
+			ref.init(refptr);
 
 			// adjust link count
-			if (ref.ptr != nullptr)
-				ref.ptr->adjust(-1, +1);	// atomic
+			if (refptr != nullptr)
+				refptr->adjust(-1, +1);	// atomic
+		}
+
+		atomic_ptr(atomic_ptr<T, R, O> && src) {	// move constructor, src is local & non-shared
+			ref = src.ref;
+			src.ref.init(nullptr);
 		}
 
 		// recycled ref objects
 		atomic_ptr(atomic_ptr_ref<T> * src) { // copy constructor
 			if (src != nullptr) {
-				src->count.ecount = 0;
-				src->count.rcount = 1;
+				src->count.set(0, 1);
 			}
-			ref.ecount = 0;
-			ref.ptr = src;	// atomic 
+			ref.init(src);	// atomic 
 		}
 
 
 		~atomic_ptr() {					// destructor
-			atomic_thread_fence(memory_order_release);
-			if (ref.ptr != nullptr && ref.ptr->adjust_mb(ref.ecount, -1) == 0) {
+			atomic_ptr_ref<T> * refptr = ref.getptr();
+
+			if (refptr != nullptr && refptr->adjust_mb(ref.getecount(), -1, O::drop) == 0) {
 				atomic_thread_fence(memory_order_acquire);
-				if (ref.ptr->pool == nullptr)
-					delete ref.ptr;
-				else
-					ref.ptr->pool(ref.ptr);
+				refptr->dispose();
 			}
 		}
 
 		atomic_ptr & operator = (T * obj) {
-			atomic_ptr<T> temp(obj);
+			atomic_ptr<T, R, O> temp(obj);
 			swap(temp);					// atomic
 			return *this;
 		}
 
 		atomic_ptr & operator = (local_ptr<T> & src) {
-			atomic_ptr<T> temp(src);
+			atomic_ptr<T, R, O> temp(src);
+			swap(temp);					// atomic
+			return *this;
+		}
+
+		atomic_ptr & operator = (atomic_ptr<T, R, O> & src) {
+			atomic_ptr<T, R, O> temp(src);
 			swap(temp);					// atomic
 			return *this;
 		}
 
-		atomic_ptr & operator = (atomic_ptr<T> & src) {
-			atomic_ptr<T> temp(src);
+		atomic_ptr & operator = (local_ptr<T> && src) {
+			store(std::move(src));
+			return *this;
+		}
+
+		atomic_ptr & operator = (atomic_ptr<T, R, O> && src) {	// src is local & non-shared
+			atomic_ptr<T, R, O> temp(std::move(src));
 			swap(temp);					// atomic
 			return *this;
 		}
 
+		//-----------------------------------------------------------------
+		// store/exchange w/ ownership transfer.  The reference held by
+		// src becomes the link reference so no refcount adjustment is
+		// needed if src held the only reference.
+		//-----------------------------------------------------------------
+		void store(local_ptr<T> && src) {
+			atomic_ptr<T, R, O> temp(std::move(src));
+			swap(temp);					// atomic
+		}
+
+		local_ptr<T> exchange(local_ptr<T> && src) {
+			atomic_ptr<T, R, O> temp(std::move(src));
+			return exchange(temp);
+		}
+
+		//-----------------------------------------------------------------
+		// std::atomic<std::shared_ptr<T>> compatible interface w/ local_ptr
+		// in place of shared_ptr, so atomic_ptr can be swapped in by
+		// typedef.  Memory order arguments are std::memory_order values
+		// (see stdatomic.h).  Loads and stores have atomic_ptr
+		// memory visibility (see above) for any order, and an explicit
+		// seq_cst adds a full fence after stores.  Forms w/o an order
+		// argument don't add the fence; stores are interlocked exchanges
+		// which are full barriers on x86 anyway.
+		//
+		// wait blocks until the atomic_ptr no longer holds old.  Stores
+		// don't notify; call notify_one/notify_all after storing.
+		//-----------------------------------------------------------------
+		static constexpr bool is_always_lock_free = true;
+		bool is_lock_free() const { return true; }
+
+		local_ptr<T> load() { return local_ptr<T>(*this); }
+		template<typename M> local_ptr<T> load(M) { return local_ptr<T>(*this); }
+
+		void store(local_ptr<T> & src) { store(src, memory_order_relaxed); }
+
+		template<typename M> void store(local_ptr<T> && src, M mo) {
+			store(std::move(src));
+			fence(mo);
+		}
+
+		template<typename M> void store(local_ptr<T> & src, M mo) {
+			atomic_ptr<T, R, O> temp(src);
+			swap(temp);					// atomic
+			fence(mo);
+		}
+
+		local_ptr<T> exchange(local_ptr<T> & src) { return exchange(src, memory_order_relaxed); }
+
+		template<typename M> local_ptr<T> exchange(local_ptr<T> && src, M mo) {
+			atomic_ptr<T, R, O> temp(std::move(src));
+			local_ptr<T> old(exchange(temp));
+			fence(mo);
+			return old;
+		}
+
+		template<typename M> local_ptr<T> exchange(local_ptr<T> & src, M mo) {
+			atomic_ptr<T, R, O> temp(src);
+			local_ptr<T> old(exchange(temp));
+			fence(mo);
+			return old;
+		}
+
+		bool compare_exchange_strong(local_ptr<T> & expected, local_ptr<T> desired) {
+			return compare_exchange(expected, desired, false, memory_order_relaxed);
+		}
+
+		template<typename M> bool compare_exchange_strong(local_ptr<T> & expected, local_ptr<T> desired, M mo) {
+			return compare_exchange(expected, desired, false, (memory_order)mo);
+		}
+
+		template<typename M, typename N> bool compare_exchange_strong(local_ptr<T> & expected, local_ptr<T> desired, M success, N) {
+			return compare_exchange(expected, desired, false, (memory_order)success);
+		}
+
+		bool compare_exchange_weak(local_ptr<T> & expected, local_ptr<T> desired) {
+			return compare_exchange(expected, desired, true, memory_order_relaxed);
+		}
+
+		template<typename M> bool compare_exchange_weak(local_ptr<T> & expected, local_ptr<T> desired, M mo) {
+			return compare_exchange(expected, desired, true, (memory_order)mo);
+		}
+
+		template<typename M, typename N> bool compare_exchange_weak(local_ptr<T> & expected, local_ptr<T> desired, M success, N) {
+			return compare_exchange(expected, desired, true, (memory_order)success);
+		}
+
+		void wait(local_ptr<T> old) { wait(old, memory_order_relaxed); }
+
+		template<typename M> void wait(local_ptr<T> old, M) {
+			atomic_ptr_waitq::bucket & b = atomic_ptr_waitq::get(this);
+
+			// old is held so its ref can't be reused while waiting
+			while (ref.peek(O::load) == old.refptr) {
+				int event = atomic_ptr_waitq::prepare(b);
+				if (ref.peek(O::load) != old.refptr) {
+					atomic_ptr_waitq::cancel(b);
+					break;
+				}
+				atomic_ptr_waitq::wait(b, event);
+			}
+		}
+
+		void notify_one() { atomic_ptr_waitq::notify(this); }	// see atomic_ptr_waitq
+		void notify_all() { atomic_ptr_waitq::notify(this); }
+
 		
 		//-----------------------------------------------------------------
 		// generate local temp ptr to guarantee validity of ptr
@@ -394,41 +1635,106 @@ template<typename T> class atomic_ptr {
 
 		bool operator == (T * rhd) {
 			if (rhd == nullptr)
-				return (ref.ptr == nullptr);
+				return (ref.getptr() == nullptr);
 			else
 				return (local_ptr<T>(*this) == rhd);
 		}
 
 		bool operator != (T * rhd) {
 			if (rhd == nullptr)
-				return (ref.ptr != nullptr);
+				return (ref.getptr() != nullptr);
 			else
 				return (local_ptr<T>(*this) != rhd);
 		}
 
 		bool operator == (local_ptr<T> & rhd) {return (local_ptr<T>(*this) == rhd); }
 		bool operator != (local_ptr<T> & rhd) {return (local_ptr<T>(*this) != rhd); }
-		bool operator == (atomic_ptr<T> & rhd) {return (local_ptr<T>(*this) == local_ptr<T>(rhd)); }
-		bool operator != (atomic_ptr<T> & rhd) {return (local_ptr<T>(*this) != local_ptr<T>(rhd)); }
+		bool operator == (atomic_ptr<T, R, O> & rhd) {return (local_ptr<T>(*this) == local_ptr<T>(rhd)); }
+		bool operator != (atomic_ptr<T, R, O> & rhd) {return (local_ptr<T>(*this) != local_ptr<T>(rhd)); }
 
-		bool cas(local_ptr<T> cmp, atomic_ptr<T> xchg) {
-			differentialReference<T> temp;
-			bool rc = false;
+		//-----------------------------------------------------------------
+		// cas -- replace w/ xchg if current value is cmp.  xchg is local
+		// & non-shared; on success it holds the old link, which is
+		// dropped when xchg is dtor'd.  On failure xchg is unchanged and
+		// can be reused for a retry.
+		//-----------------------------------------------------------------
+		bool cas(const local_ptr<T> & cmp, atomic_ptr<T, R, O> & xchg) {
+			return ref.cas(cmp.refptr, xchg.ref);
+		}
 
-			temp.ecount = ref.ecount;
-			temp.ptr = cmp.refptr;
+		bool cas(const local_ptr<T> & cmp, atomic_ptr<T, R, O> && xchg) {
+			return ref.cas(cmp.refptr, xchg.ref);
+		}
 
-			do {
-				if (atomic_compare_exchange_strong_explicit(&ref, &temp, xchg.ref, memory_order_acq_rel, memory_order_relaxed)) {
-					xchg.ref = temp;
-					rc = true;
-					break;
-				}
+		//-----------------------------------------------------------------
+		// update -- read-copy-update.  fn(const T & old) returns a
+		// local_ptr<T> to the replacement, which is installed w/ cas if
+		// the atomic_ptr still holds old.  On failure fn is called again
+		// on the new value after a bounded exponential backoff.  Returns
+		// false w/o calling fn if the atomic_ptr is null.
+		//
+		// The second form reuses one preallocated replacement, next, for
+		// every attempt.  fn(const T & old, T & next) fills in next in
+		// place.  next must be non-shared.  Returns false w/o calling fn
+		// if next is null.
+		//-----------------------------------------------------------------
+		template<typename F> bool update(F && fn) {
+			atomic_ptr_backoff backoff;
+			CASPROBE(site_update, &ref);
+
+			for (;;) {
+				CASTRY();
+				local_ptr<T> cmp(*this);
+				if (cmp.refptr == nullptr)
+					return false;
+
+				atomic_ptr<T, R, O> xchg(fn((const T &)*cmp));
+				if (tryupdate(cmp, xchg))
+					return true;
+				backoff();
+			}
+		}
 
+		template<typename F> bool update(local_ptr<T> && next, F && fn) {
+			atomic_ptr<T, R, O> xchg(std::move(next));
+			T * obj;
+			atomic_ptr_backoff backoff;
+			CASPROBE(site_update, &ref);
+
+			if (xchg.ref.getptr() == nullptr || (obj = xchg.ref.getptr()->ptr) == nullptr)
+				return false;
+
+			for (;;) {
+				CASTRY();
+				local_ptr<T> cmp(*this);
+				if (cmp.refptr == nullptr)
+					return false;
+
+				fn((const T &)*cmp, *obj);
+				if (tryupdate(cmp, xchg))
+					return true;
+				backoff();
 			}
-			while (cmp.refptr == temp.ptr);
+		}
 
-			return rc;
+		//-----------------------------------------------------------------
+		// update contention counters, zero unless compiled w/
+		// ATOMIC_PTR_UPDATE_STATS.  Counts are approximate.
+		//-----------------------------------------------------------------
+		long getUpdateAttempts() {
+#ifdef ATOMIC_PTR_UPDATE_STATS
+			return atomic_load_explicit(&attempts, memory_order_relaxed);
+#else
+			return 0;
+#endif
+		}
+
+		long getUpdateFailures() {
+#ifdef ATOMIC_PTR_UPDATE_STATS
+			return atomic_load_explicit(&failures, memory_order_relaxed);
+#else
+			return 0;
+#endif
 		}
 
 		//-----------------------------------------------------------------
@@ -436,60 +1742,147 @@ template<typename T> class atomic_ptr {
 		//-----------------------------------------------------------------
 
 		void recyle(atomic_ptr_ref<T> * src) {
-			atomic_ptr<T> temp(src);
+			atomic_ptr<T, R, O> temp(src);
 			swap(temp);	// atomic
 			//return *this;
 		}
 
 	//protected:
 		// atomic
-		void swap(atomic_ptr<T> & obj) {	// obj is local & non-shared
-			/*
-			differentialReference<T> temp;
-
-			temp.ecount = ref.ecount;
-			temp.ptr = ref.ptr;
-
-			while(!atomic_compare_exchange_strong_explicit(&ref, &temp, obj.ref, memory_order_release, memory_order_relaxed));
-
-			obj.ref.ecount = temp.ecount;
-			obj.ref.ptr = temp.ptr;
-			*/
-			obj.ref = atomic_exchange_explicit(&ref, obj.ref, memory_order_release, memory_order_relaxed);
+		void swap(atomic_ptr<T, R, O> & obj) {	// obj is local & non-shared
+			ref.exchange(obj.ref, O::store);
 		}
 
 	private:
 
 		// atomic
 		atomic_ptr_ref<T> * getrefptr() {
-			differentialReference<T> oldval, newval;
+			return ref.acquire(O::load);
+		}
 
-			oldval.ecount = ref.ecount;
-			oldval.ptr = ref.ptr;
+		// swap in temp and return old value as local_ptr
+		local_ptr<T> exchange(atomic_ptr<T, R, O> & temp) {
+			atomic_ptr_ref<T> * refptr;
+			local_ptr<T> old;
 
-			do {
-				newval.ecount = oldval.ecount + 1;
-				newval.ptr = oldval.ptr;
+			swap(temp);					// atomic
+
+			// convert old link reference to ephemeral reference
+			if ((refptr = temp.ref.getptr()) != nullptr) {
+				refptr->adjust_mb(temp.ref.getecount() + 1, -1);
+				old.adopt(refptr);
+				temp.ref.init(nullptr);
 			}
-			while (!atomic_compare_exchange_strong_explicit(&ref, &oldval, newval, memory_order_relaxed, memory_order_relaxed));
 
-			return atomic_load_explicit(&oldval.ptr, MEMBAR0);
+			return old;
+		}
+
+		//
+		// compare_exchange -- on failure expected is set to the current
+		// value.  The strong form retries if the cas failed only because
+		// the value changed back to expected before it could be loaded.
+		//
+		bool compare_exchange(local_ptr<T> & expected, local_ptr<T> & desired, bool weak, memory_order mo) {
+			atomic_ptr<T, R, O> xchg(std::move(desired));
+
+			for (;;) {
+				if (ref.cas(expected.refptr, xchg.ref)) {
+					fence(mo);
+					return true;		// xchg holds old link
+				}
+
+				local_ptr<T> current(*this);
+				if (weak || current.refptr != expected.refptr) {
+					expected.swap(current);
+					return false;
+				}
+			}
+		}
+
+		template<typename M> static void fence(M mo) {
+			if ((int)mo == (int)memory_order_seq_cst)
+				atomic_thread_fence(memory_order_seq_cst);
+		}
+
+		bool tryupdate(const local_ptr<T> & cmp, atomic_ptr<T, R, O> & xchg) {
+			bool rc = ref.cas(cmp.refptr, xchg.ref);
+#ifdef ATOMIC_PTR_UPDATE_STATS
+			atomic_fetch_add_explicit(&attempts, 1, memory_order_relaxed);
+			if (!rc)
+				atomic_fetch_add_explicit(&failures, 1, memory_order_relaxed);
+#endif
+			return rc;
 		}
 
 }; // class atomic_ptr
 
-template<typename T> inline bool operator == (int lhd, atomic_ptr<T> & rhd)
+template<typename T, template<typename> class R, typename O> inline bool operator == (int lhd, atomic_ptr<T, R, O> & rhd)
 	{ return ((T *)lhd == rhd); }
 
-template<typename T> inline bool operator != (int lhd, atomic_ptr<T> & rhd)
+template<typename T, template<typename> class R, typename O> inline bool operator != (int lhd, atomic_ptr<T, R, O> & rhd)
 	{ return ((T *)lhd != rhd); }
 
-template<typename T> inline bool operator == (T * lhd, atomic_ptr<T> & rhd)
+template<typename T, template<typename> class R, typename O> inline bool operator == (T * lhd, atomic_ptr<T, R, O> & rhd)
 	{ return (rhd == lhd); }
 
-template<typename T> inline bool operator != (T * lhd, atomic_ptr<T> & rhd)
+template<typename T, template<typename> class R, typename O> inline bool operator != (T * lhd, atomic_ptr<T, R, O> & rhd)
 	{ return (rhd != lhd); }
 
+
+//-----------------------------------------------------------------------------
+// make_local/make_atomic -- construct object and refcount in single allocation
+//-----------------------------------------------------------------------------
+template<typename T, typename... Args> inline local_ptr<T> make_local(Args&&... args) {
+	atomic_ptr_ref<T> * refptr = new atomic_ptr_block<T>(std::forward<Args>(args)...);
+	return local_ptr<T>(refptr);		// refcount {1, 0}
+}
+
+template<typename T, template<typename> class R = differentialReference, typename O = ordering::acquire_loads, typename... Args> inline atomic_ptr<T, R, O> make_atomic(Args&&... args) {
+	atomic_ptr_ref<T> * refptr = new atomic_ptr_block<T>(std::forward<Args>(args)...);
+	return atomic_ptr<T, R, O>(refptr);	// refcount {0, 1}
+}
+
+//-----------------------------------------------------------------------------
+// allocate_local -- make_local w/ ref and object allocated by alloc
+//-----------------------------------------------------------------------------
+template<typename T, typename A, typename... Args> inline local_ptr<T> allocate_local(const A & alloc, Args&&... args) {
+	atomic_ptr_ref<T> * refptr = atomic_ptr_alloc_block<T, A>::create(alloc, std::forward<Args>(args)...);
+	return local_ptr<T>(refptr);		// refcount {1, 0}
+}
+
+//-----------------------------------------------------------------------------
+// make_local_array -- array of n T, deleted w/ delete[]
+//-----------------------------------------------------------------------------
+template<typename T> inline local_ptr<T> make_local_array(size_t n) {
+	return local_ptr<T>(new T[n](), atomic_ptr_delete_array<T>());
+}
+
+//-----------------------------------------------------------------------------
+// atomic_ptr_unlink -- drop an atomic_ptr link to a chain of nodes, for
+// use in node destructors of linked structures.  Nodes freed by the drop
+// are unlinked from a thread local stack instead of recursively so
+// releasing a long chain doesn't overflow the stack.
+//-----------------------------------------------------------------------------
+template<typename T, template<typename> class R, typename O> inline void atomic_ptr_unlink(atomic_ptr<T, R, O> & link) {
+	static thread_local std::vector<local_ptr<T>> pending;
+	static thread_local bool draining = false;
+
+	local_ptr<T> temp = link.exchange(local_ptr<T>());
+	if (!temp)
+		return;
+
+	pending.push_back(std::move(temp));
+	if (draining)
+		return;
+
+	draining = true;
+	while (!pending.empty()) {
+		local_ptr<T> next(std::move(pending.back()));
+		pending.pop_back();
+	}								// ~next may push more
+	draining = false;
+}
+
 #endif // _ATOMIC_PTR_H
 
 
@@ -0,0 +1,323 @@
+/*
+   Copyright 2002-2013 Joseph W. Seigh
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+//------------------------------------------------------------------------------
+// atomic_ptr_map -- lock-free split-ordered list hash map using atomic_ptr
+//
+// version -- 0.0.x (pre-alpha)
+//
+//
+// Shalev-Shavit split-ordered list.  All entries are in a single linked
+// list sorted by bit reversed hash (split order) and each bucket is an
+// atomic_ptr to a dummy node in the list that starts the run of entries
+// for that bucket.  Doubling the number of buckets only splits existing
+// runs, so the table grows w/o moving entries or stopping readers.  New
+// buckets are initialized lazily by inserting their dummy node after
+// their parent bucket's dummy.
+//
+// The list links are atomic_ptrs so a node stays valid while any thread
+// holds a local_ptr to it.  Erase first logically deletes a node by
+// inserting a marker node after it, which makes any cas on its next link
+// fail, then unlinks it.  Traversals unlink marked nodes they run into.
+// Pointer bits aren't available for marking since the link is an
+// atomic_ptr.
+//
+// Buckets are kept in segments of doubling size so growing the table
+// allocates a new segment instead of copying the bucket array.  Segments
+// are freed when the map is destroyed.
+//
+// Entries are immutable once inserted.  find copies the value out;
+// replace a value w/ erase and insert.
+//
+// memory visibility:
+//   insert has release semantics and a find that finds the entry has
+// acquire semantics w/ respect to the entry.
+//
+//------------------------------------------------------------------------------
+
+#ifndef _ATOMIC_PTR_MAP_H
+#define _ATOMIC_PTR_MAP_H
+
+#include <stdint.h>
+#include <functional>
+#include <atomic_ptr.h>
+
+template<typename K, typename V, typename H = std::hash<K>, typename E = std::equal_to<K>> class atomic_ptr_map {
+	public:
+		static const int maxSegments = 48;			// max 2^48 buckets
+		static const long maxLoad = 2;				// entries per bucket before growing
+
+		atomic_ptr_map(size_t nbuckets = 16) {
+			size_t n = 2;
+			while (n < nbuckets && n < ((size_t)1 << (maxSegments - 1)))
+				n <<= 1;
+
+			for (int j = 0; j < maxSegments; j++)
+				segments[j] = nullptr;
+			buckets = n;
+			count = 0;
+
+			slot(0) = make_local<node>((uint64_t)0, node::bucket);	// list head
+		}
+
+		// no concurrent access
+		~atomic_ptr_map() {
+			for (int j = 0; j < maxSegments; j++)
+				delete[] segments[j];					// nodes released by ~node
+		}
+
+		//-----------------------------------------------------------------
+		// insert -- false if key already present
+		//-----------------------------------------------------------------
+		bool insert(const K & key, const V & value) {
+			size_t h = hash(key);
+			local_ptr<node> start = bucket(h);
+			local_ptr<node> item = make_local<node>(itemKey(h), key, value);
+			local_ptr<node> pred, curr;
+
+			for (;;) {
+				if (search(start, item->sokey, &key, pred, curr))
+					return false;
+
+				item->next = curr;					// not shared yet
+				if (pred->next.cas(curr, atomic_ptr<node>(item)))
+					break;
+			}
+
+			long n = atomic_add_fetch_explicit(&count, 1L, memory_order_relaxed);
+			size_t nb = atomic_load_explicit(&buckets, memory_order_relaxed);
+			if (n > (long)nb * maxLoad && nb < ((size_t)1 << (maxSegments - 1)))
+				atomic_compare_exchange_strong_explicit(&buckets, &nb, nb * 2, memory_order_relaxed, memory_order_relaxed);
+
+			return true;
+		}
+
+		//-----------------------------------------------------------------
+		// find -- copy value to value, false if not found
+		//-----------------------------------------------------------------
+		bool find(const K & key, V & value) {
+			local_ptr<node> curr;
+
+			if (!lookup(key, curr))
+				return false;
+			value = curr->item()->second;
+			return true;
+		}
+
+		bool contains(const K & key) {
+			local_ptr<node> curr;
+			return lookup(key, curr);
+		}
+
+		//-----------------------------------------------------------------
+		// erase -- false if key not present
+		//-----------------------------------------------------------------
+		bool erase(const K & key) {
+			size_t h = hash(key);
+			uint64_t sokey = itemKey(h);
+			local_ptr<node> start = bucket(h);
+			local_ptr<node> pred, curr;
+
+			for (;;) {
+				if (!search(start, sokey, &key, pred, curr))
+					return false;
+
+				local_ptr<node> succ(curr->next);
+				if (succ != nullptr && succ->kind == node::marker)
+					continue;						// being erased, search unlinks it
+
+				local_ptr<node> marker = make_local<node>((uint64_t)0, node::marker);
+				marker->next = succ;
+				if (!curr->next.cas(succ, atomic_ptr<node>(marker)))
+					continue;
+
+				// erased, unlink or leave it to whoever is in the way
+				if (!pred->next.cas(curr, atomic_ptr<node>(succ)))
+					search(start, sokey, &key, pred, curr);
+
+				atomic_fetch_sub_explicit(&count, 1L, memory_order_relaxed);
+				return true;
+			}
+		}
+
+		// approximate while updates are in progress
+		size_t size() {
+			long n = atomic_load_explicit(&count, memory_order_relaxed);
+			return (n > 0) ? (size_t)n : 0;
+		}
+
+		size_t getBuckets() { return atomic_load_explicit(&buckets, memory_order_relaxed); }
+
+	private:
+		typedef std::pair<const K, V> item_t;
+
+		struct node {
+			enum kind_t { item_node, bucket, marker };
+
+			uint64_t			sokey;				// split order key
+			kind_t				kind;
+			typename std::aligned_storage<sizeof(item_t), alignof(item_t)>::type storage;
+			atomic_ptr<node>	next;
+
+			node(uint64_t so, kind_t k) : sokey(so), kind(k) {}
+
+			node(uint64_t so, const K & key, const V & value) : sokey(so), kind(item_node) {
+				new (&storage) item_t(key, value);
+			}
+
+			~node() {
+				if (kind == item_node)
+					item()->~item_t();
+				atomic_ptr_unlink(next);
+			}
+
+			item_t * item() { return reinterpret_cast<item_t *>(&storage); }
+		};
+
+		atomic_ptr<node> *	segments[maxSegments];	// bucket segments
+		alignas(64) size_t	buckets;				// # buckets, power of 2
+		alignas(64) long	count;					// # entries
+		H					hash;
+		E					equal;
+
+		atomic_ptr_map(const atomic_ptr_map &);
+		atomic_ptr_map & operator = (const atomic_ptr_map &);
+
+		static uint64_t reverse(uint64_t x) {
+			x = ((x >> 1) & 0x5555555555555555ULL) | ((x & 0x5555555555555555ULL) << 1);
+			x = ((x >> 2) & 0x3333333333333333ULL) | ((x & 0x3333333333333333ULL) << 2);
+			x = ((x >> 4) & 0x0f0f0f0f0f0f0f0fULL) | ((x & 0x0f0f0f0f0f0f0f0fULL) << 4);
+			return __builtin_bswap64(x);
+		}
+
+		// entries sort after their bucket's dummy node
+		static uint64_t itemKey(size_t h) { return reverse((uint64_t)h | (1ULL << 63)); }
+		static uint64_t bucketKey(size_t b) { return reverse((uint64_t)b); }
+
+		//
+		// bucket slot, segment 0 is buckets 0 and 1, segment s > 0 is
+		// buckets 2^s .. 2^(s+1)-1.  Segments are allocated on first use.
+		//
+		atomic_ptr<node> & slot(size_t b) {
+			int s = (b < 2) ? 0 : 63 - __builtin_clzl(b);
+			size_t base = (s == 0) ? 0 : ((size_t)1 << s);
+			atomic_ptr<node> * segment = atomic_load_explicit(&segments[s], memory_order_acquire);
+
+			if (segment == nullptr) {
+				atomic_ptr<node> * temp = new atomic_ptr<node>[(s == 0) ? 2 : ((size_t)1 << s)];
+				if (atomic_compare_exchange_strong_explicit(&segments[s], &segment, temp, memory_order_acq_rel, memory_order_acquire))
+					segment = temp;
+				else
+					delete[] temp;
+			}
+
+			return segment[b - base];
+		}
+
+		// dummy node for hash h's bucket
+		local_ptr<node> bucket(size_t h) {
+			return getBucket(h & (atomic_load_explicit(&buckets, memory_order_relaxed) - 1));
+		}
+
+		local_ptr<node> getBucket(size_t b) {
+			atomic_ptr<node> & s = slot(b);
+			local_ptr<node> dummy(s);
+
+			if (dummy == nullptr) {
+				initBucket(b, s);
+				dummy = s;
+			}
+			return dummy;
+		}
+
+		//
+		// insert bucket b's dummy node after its parent's, the bucket w/
+		// the top bit of b cleared.  If another thread got there first its
+		// dummy node is used.
+		//
+		void initBucket(size_t b, atomic_ptr<node> & s) {
+			size_t parent = b & ~((size_t)1 << (63 - __builtin_clzl(b)));
+			local_ptr<node> start = getBucket(parent);
+			local_ptr<node> dummy = make_local<node>(bucketKey(b), node::bucket);
+			local_ptr<node> pred, curr;
+
+			for (;;) {
+				if (search(start, dummy->sokey, nullptr, pred, curr)) {
+					dummy = curr;
+					break;
+				}
+
+				dummy->next = curr;					// not shared yet
+				if (pred->next.cas(curr, atomic_ptr<node>(dummy)))
+					break;
+			}
+
+			local_ptr<node> empty;
+			s.cas(empty, atomic_ptr<node>(dummy));
+		}
+
+		bool lookup(const K & key, local_ptr<node> & curr) {
+			size_t h = hash(key);
+			local_ptr<node> start = bucket(h);
+			local_ptr<node> pred;
+
+			return search(start, itemKey(h), &key, pred, curr);
+		}
+
+		//
+		// search list from start for the entry for key, or the dummy node
+		// if key is null.  Returns true w/ curr the node if found, else
+		// false w/ curr the first node after where it would go.  Either
+		// way pred->next held curr when it was read.  Marked nodes are
+		// unlinked along the way.
+		//
+		bool search(local_ptr<node> & start, uint64_t sokey, const K * key, local_ptr<node> & pred, local_ptr<node> & curr) {
+			retry:
+			pred = start;
+			curr = pred->next;
+
+			while (curr != nullptr) {
+				local_ptr<node> succ(curr->next);
+
+				if (succ != nullptr && succ->kind == node::marker) {
+					local_ptr<node> after(succ->next);
+					if (!pred->next.cas(curr, atomic_ptr<node>(after)))
+						goto retry;
+					curr = std::move(after);
+					continue;
+				}
+
+				if (curr->sokey > sokey)
+					return false;
+
+				if (curr->sokey == sokey) {
+					if (key == nullptr ? (curr->kind == node::bucket) : (curr->kind == node::item_node && equal(curr->item()->first, *key)))
+						return true;
+				}
+
+				pred = std::move(curr);			// moves, no refcount adjusts
+				curr = std::move(succ);
+			}
+
+			return false;
+		}
+
+}; // class atomic_ptr_map
+
+#endif // _ATOMIC_PTR_MAP_H
+
+
+/*-*/
@@ -0,0 +1,250 @@
+/*
+   Copyright 2002-2013 Joseph W. Seigh
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+//------------------------------------------------------------------------------
+// atomic_ptr_pool -- recycling pool for atomic_ptr_ref objects
+//
+// version -- 0.0.x (pre-alpha)
+//
+//
+// Refs whose counts go to zero are recycled through the atomic_ptr_ref
+// pool interface instead of being deleted.  The referenced object is
+// recycled along with the ref, as w/ local_ptr::recycle, so objects
+// obtained from the pool are in whatever state they were last left in.
+//
+// Each thread caches refs in two magazines (fixed size arrays).  Full
+// magazines are exchanged w/ a global depot, a pair of lock-free stacks
+// of full and empty magazines, so the depot is only touched once per
+// magsize puts or gets.  Magazines are never freed which lets the depot
+// stacks be popped w/o hazard pointers; a sequence count handles ABA.
+//
+// One pool per type T, so atomic_ptr_pool<T>::put can be used as a
+// pool_put_t.
+//
+// Refs dropped after the thread's cache has been destroyed, e.g. by
+// static destructors after the main thread's thread_local ones have
+// run, are deleted and gets allocate new refs.
+//
+//------------------------------------------------------------------------------
+
+#ifndef _ATOMIC_PTR_POOL_H
+#define _ATOMIC_PTR_POOL_H
+
+#include <atomic_ptr.h>
+
+template<typename T> class atomic_ptr_pool {
+	public:
+		static const int magsize = 64;		// refs per magazine
+
+		//-----------------------------------------------------------------
+		// get -- recycled ref or new one w/ pool set, refcount {1, 0}
+		//-----------------------------------------------------------------
+		static local_ptr<T> get() {
+			atomic_ptr_ref<T> * refptr;
+
+			if ((refptr = take()) != nullptr)
+				return local_ptr<T>(refptr);	// pool unchanged
+
+			local_ptr<T> temp(make_local<T>());
+			temp.setPool(&put);
+			return temp;
+		}
+
+		//-----------------------------------------------------------------
+		// put -- recycle ref w/ zero refcounts (pool_put_t)
+		//-----------------------------------------------------------------
+		static void put(void * ref) {
+			if (cachedown) {					// thread exiting
+				local_ptr<T> temp((atomic_ptr_ref<T> *)ref);
+				temp.setPool(nullptr);			// delete on dtor
+				return;
+			}
+
+			cache_t & c = cache;
+
+			if (c.loaded == nullptr)
+				c.loaded = newMagazine();
+
+			if (c.loaded->count == magsize) {
+				if (c.previous != nullptr && c.previous->count == 0) {
+					magazine * temp = c.loaded;
+					c.loaded = c.previous;
+					c.previous = temp;
+				}
+				else {
+					if (c.previous != nullptr)
+						putFull(c.previous);
+					c.previous = c.loaded;
+					c.loaded = newMagazine();
+				}
+			}
+
+			c.loaded->refs[c.loaded->count++] = (atomic_ptr_ref<T> *)ref;
+		}
+
+		//-----------------------------------------------------------------
+		// set/get maximum number of full magazines in depot. Refs
+		// in excess magazines are deleted.
+		//-----------------------------------------------------------------
+		static void setMaxDepot(long n) {
+			atomic_store_explicit(&maxdepot, n, memory_order_relaxed);
+		}
+
+		static long getMaxDepot() {
+			return atomic_load_explicit(&maxdepot, memory_order_relaxed);
+		}
+
+	private:
+		struct magazine {
+			magazine *	next;
+			int			count;
+			atomic_ptr_ref<T> * refs[magsize];
+		};
+
+		struct alignas(sizeof(ival)) stack_t {
+			magazine *	ptr;
+			long		sequence;
+		};
+
+		//
+		// thread local magazines, returned to depot on thread exit
+		//
+		struct cache_t {
+			magazine *	loaded;
+			magazine *	previous;
+
+			cache_t() : loaded(nullptr), previous(nullptr) {}
+
+			~cache_t() {
+				cachedown = true;
+				if (loaded != nullptr)
+					putFull(loaded);
+				if (previous != nullptr)
+					putFull(previous);
+				loaded = nullptr;
+				previous = nullptr;
+			}
+		};
+
+		static thread_local cache_t cache;
+		static thread_local bool cachedown;	// cache destroyed, no dtor so usable after
+		static stack_t	full;				// depot full magazines
+		static stack_t	empty;				// depot empty magazines
+		static long		depot;				// # full magazines in depot
+		static long		maxdepot;			// max full magazines in depot
+
+
+		static atomic_ptr_ref<T> * take() {
+			magazine * mag;
+
+			if (cachedown)
+				return nullptr;
+
+			cache_t & c = cache;
+
+			if (c.loaded != nullptr && c.loaded->count > 0)
+				return c.loaded->refs[--c.loaded->count];
+
+			if (c.previous != nullptr && c.previous->count > 0) {
+				mag = c.loaded;
+				c.loaded = c.previous;
+				c.previous = mag;
+				return c.loaded->refs[--c.loaded->count];
+			}
+
+			if ((mag = pop(full)) == nullptr)
+				return nullptr;
+			atomic_fetch_sub_explicit(&depot, 1, memory_order_relaxed);
+
+			if (c.previous != nullptr)
+				push(empty, c.previous);
+			c.previous = c.loaded;
+			c.loaded = mag;
+
+			return c.loaded->refs[--c.loaded->count];
+		}
+
+		static magazine * newMagazine() {
+			magazine * mag;
+
+			if ((mag = pop(empty)) == nullptr)
+				mag = new magazine;
+			mag->count = 0;
+			return mag;
+		}
+
+		// return magazine to depot, deleting refs if depot full
+		static void putFull(magazine * mag) {
+			if (mag->count > 0 && atomic_fetch_add_explicit(&depot, 1, memory_order_relaxed) < getMaxDepot()) {
+				push(full, mag);
+				return;
+			}
+
+			if (mag->count > 0)
+				atomic_fetch_sub_explicit(&depot, 1, memory_order_relaxed);
+
+			while (mag->count > 0) {
+				local_ptr<T> temp(mag->refs[--mag->count]);
+				temp.setPool(nullptr);			// delete on dtor
+			}
+			push(empty, mag);
+		}
+
+		//-----------------------------------------------------------------
+		// lock-free stack w/ sequence count for ABA
+		//-----------------------------------------------------------------
+		static void push(stack_t & stack, magazine * mag) {
+			stack_t oldval, newval;
+
+			oldval.sequence = atomic_load_explicit(&stack.sequence, memory_order_relaxed);
+			oldval.ptr = atomic_load_explicit(&stack.ptr, memory_order_relaxed);
+			do {
+				mag->next = oldval.ptr;
+				newval.ptr = mag;
+				newval.sequence = oldval.sequence + 1;
+			}
+			while (!atomic_ptr_dwcas(&stack, &oldval, &newval, memory_order_release, memory_order_relaxed));
+		}
+
+		static magazine * pop(stack_t & stack) {
+			stack_t oldval, newval;
+
+			oldval.sequence = atomic_load_explicit(&stack.sequence, memory_order_relaxed);
+			oldval.ptr = atomic_load_explicit(&stack.ptr, memory_order_acquire);
+			while (oldval.ptr != nullptr) {
+				// magazines are never freed so next is safe to load
+				newval.ptr = atomic_load_explicit(&oldval.ptr->next, memory_order_relaxed);
+				newval.sequence = oldval.sequence + 1;
+				if (atomic_ptr_dwcas(&stack, &oldval, &newval, memory_order_acquire, memory_order_acquire))
+					return oldval.ptr;
+			}
+
+			return nullptr;
+		}
+
+}; // class atomic_ptr_pool
+
+template<typename T> thread_local typename atomic_ptr_pool<T>::cache_t atomic_ptr_pool<T>::cache;
+template<typename T> thread_local bool atomic_ptr_pool<T>::cachedown = false;
+template<typename T> typename atomic_ptr_pool<T>::stack_t atomic_ptr_pool<T>::full = {nullptr, 0};
+template<typename T> typename atomic_ptr_pool<T>::stack_t atomic_ptr_pool<T>::empty = {nullptr, 0};
+template<typename T> long atomic_ptr_pool<T>::depot = 0;
+template<typename T> long atomic_ptr_pool<T>::maxdepot = 1024;
+
+#endif // _ATOMIC_PTR_POOL_H
+
+
+/*-*/
@@ -0,0 +1,187 @@
+/*
+   Copyright 2002-2013 Joseph W. Seigh
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+//------------------------------------------------------------------------------
+// atomic_ptr_queue -- lock-free MPMC fifo queue using atomic_ptr
+//
+// version -- 0.0.x (pre-alpha)
+//
+//
+// Michael-Scott queue w/ the head, tail and node links as atomic_ptrs.
+// A node can't be freed or reused while any thread holds a local_ptr to
+// it, so there is no ABA problem and no separate reclamation scheme.
+// head points to a dummy node; the first queued value is in head->next.
+//
+// The value is moved out of a node by the dequeuer that won the cas on
+// head, after the cas, so T only needs to be movable and no other thread
+// ever reads it.  The node stays on as the new dummy.
+//
+// Dequeued nodes are linked to each other so a thread holding an old node
+// keeps every node queued after it alive until it lets go.  ~node drops
+// its link iteratively, not recursively, so releasing a long chain of
+// dequeued nodes doesn't overflow the stack.
+//
+// Capacity, if non zero, bounds the number of queued values.  The count
+// is only kept for bounded queues and is approximate while enqueues and
+// dequeues are in progress.
+//
+// memory visibility:
+//   Enqueue has release semantics and a successful dequeue has acquire
+// semantics w/ respect to the value.
+//
+//------------------------------------------------------------------------------
+
+#ifndef _ATOMIC_PTR_QUEUE_H
+#define _ATOMIC_PTR_QUEUE_H
+
+#include <atomic_ptr.h>
+
+template<typename T> class atomic_ptr_queue {
+	public:
+
+		atomic_ptr_queue(size_t capacity = 0) : capacity(capacity) {
+			local_ptr<node> dummy = make_local<node>();
+			head = dummy;
+			tail = dummy;
+			count = 0;
+		}
+
+		// no concurrent access
+		~atomic_ptr_queue() {
+			tail = (node *)nullptr;
+			head = (node *)nullptr;			// nodes released by ~node
+		}
+
+		//-----------------------------------------------------------------
+		// enqueue -- false if bounded and full
+		//-----------------------------------------------------------------
+		bool enqueue(const T & value) { return put(make_local<node>(value_tag(), value)); }
+		bool enqueue(T && value) { return put(make_local<node>(value_tag(), std::move(value))); }
+
+		template<typename... Args> bool emplace(Args&&... args) {
+			return put(make_local<node>(value_tag(), std::forward<Args>(args)...));
+		}
+
+		//-----------------------------------------------------------------
+		// try_dequeue -- false if empty
+		//-----------------------------------------------------------------
+		bool try_dequeue(T & value) {
+			atomic_ptr_backoff backoff;
+
+			for (;;) {
+				local_ptr<node> h(head);
+				local_ptr<node> next(h->next);
+				if (next == nullptr)
+					return false;
+
+				// tail may lag head here by the node being enqueued.  The
+				// enqueuer, or the next one, moves tail past it.
+				if (head.cas(h, atomic_ptr<node>(next))) {
+					value = std::move(*next->value());
+					next->clear();
+					if (capacity != 0)
+						atomic_fetch_sub_explicit(&count, 1L, memory_order_relaxed);
+					return true;
+				}
+				backoff();
+			}
+		}
+
+		bool empty() {
+			local_ptr<node> h(head);
+			return (h->next == (node *)nullptr);
+		}
+
+		// # queued values, bounded queues only
+		size_t size() {
+			long n = atomic_load_explicit(&count, memory_order_relaxed);
+			return (n > 0) ? (size_t)n : 0;
+		}
+
+		size_t getCapacity() { return capacity; }
+
+	private:
+		struct value_tag {};
+
+		struct node {
+			typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+			bool				full;		// storage holds a value
+			atomic_ptr<node>	next;
+
+			node() : full(false) {}			// dummy
+
+			template<typename... Args> node(value_tag, Args&&... args) : full(false) {
+				new (&storage) T(std::forward<Args>(args)...);
+				full = true;
+			}
+
+			~node() {
+				clear();
+				atomic_ptr_unlink(next);
+			}
+
+			T * value() { return reinterpret_cast<T *>(&storage); }
+
+			void clear() {
+				if (full) {
+					value()->~T();
+					full = false;
+				}
+			}
+		};
+
+		alignas(64) atomic_ptr<node>	head;
+		alignas(64) atomic_ptr<node>	tail;
+		alignas(64) long				count;
+		size_t						capacity;
+
+		atomic_ptr_queue(const atomic_ptr_queue &);
+		atomic_ptr_queue & operator = (const atomic_ptr_queue &);
+
+		bool put(local_ptr<node> && item) {
+			if (capacity != 0) {
+				if (atomic_fetch_add_explicit(&count, 1L, memory_order_relaxed) >= (long)capacity) {
+					atomic_fetch_sub_explicit(&count, 1L, memory_order_relaxed);
+					return false;
+				}
+			}
+
+			atomic_ptr<node> link(item);		// reused on retry
+			local_ptr<node> empty;
+			atomic_ptr_backoff backoff;
+
+			for (;;) {
+				local_ptr<node> t(tail);
+				local_ptr<node> next(t->next);
+
+				if (next == nullptr) {
+					if (t->next.cas(empty, link)) {
+						tail.cas(t, atomic_ptr<node>(item));	// ok if someone else moved it
+						return true;
+					}
+					backoff();
+				}
+				else
+					tail.cas(t, atomic_ptr<node>(next));		// help lagging tail
+			}
+		}
+
+}; // class atomic_ptr_queue
+
+#endif // _ATOMIC_PTR_QUEUE_H
+
+
+/*-*/
@@ -0,0 +1,270 @@
+/*
+   Copyright 2002-2013 Joseph W. Seigh
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+//------------------------------------------------------------------------------
+// atomic_ptr_smr -- hazard pointer borrowed reads for atomic_ptr
+//
+// version -- 0.0.x (pre-alpha)
+//
+//
+// An atomic_ptr_guard protects the atomic_ptr_ref currently in an
+// atomic_ptr w/ a fastsmr hazard pointer instead of acquiring an
+// ephemeral reference.  Reads are a store into the thread's hazard
+// pointer and a reload of the atomic_ptr; neither the atomic_ptr nor
+// the refcount is written.  fastsmr's RCU passes make the hazard pointer
+// store visible to smr_scan w/o a store/load membar.
+//
+// Refs must not be freed while a guard may hold them, so refs stored
+// into guarded atomic_ptrs must come from atomic_ptr_smr<T>::make, which
+// allocates the object, the ref and the ref's rcu_defer_t in one block
+// and sets the recycle pool that defers the delete w/ smr_defer.
+// rcu_startup must have been called.
+//
+// A guard that needs the object beyond its scope can promote to a
+// local_ptr, which fails (returns null) if the refcount already went
+// to zero.
+//
+// Guards take hazard pointers from a per thread free list, filled a
+// pair at a time from fastsmr, and give them back when destroyed, in
+// any order.  So guards can be moved, returned by borrow, and outlive
+// guards made after them.  A thread keeps its pairs until it exits, as
+// many as the most guards it has had live at once.  A guard must be
+// destroyed by the thread that made it.  A thread that calls
+// rcu_shutdown after borrowing must give its pairs back first w/
+// atomic_ptr_hazards::release().
+//
+//------------------------------------------------------------------------------
+
+#ifndef _ATOMIC_PTR_SMR_H
+#define _ATOMIC_PTR_SMR_H
+
+#include <pthread.h>
+#include <vector>
+#include <fastsmr.h>
+#include <atomic_ptr.h>
+
+//=============================================================================
+// atomic_ptr_smr_block -- atomic_ptr_block w/ the rcu_defer_t for its
+// deferred delete in the same allocation
+//=============================================================================
+template<typename T> class atomic_ptr_smr_block : public atomic_ptr_ref<T> {
+	public:
+		template<typename... Args> atomic_ptr_smr_block(Args&&... args) : atomic_ptr_ref<T>(nullptr) {
+			this->ptr = new (&storage) T(std::forward<Args>(args)...);
+			this->ops = &smrOps;
+		}
+
+		rcu_defer_t	defer;					// deferred delete, atomic_ptr_smr<T>::put
+
+	private:
+		typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+
+		static const typename atomic_ptr_ref<T>::ops_t smrOps;
+
+		static void deleteBlock(atomic_ptr_ref<T> * ref) {
+			delete static_cast<atomic_ptr_smr_block<T> *>(ref);
+		}
+
+}; // class atomic_ptr_smr_block
+
+template<typename T> const typename atomic_ptr_ref<T>::ops_t atomic_ptr_smr_block<T>::smrOps = {
+	&atomic_ptr_destroy_inplace<T>,
+	&atomic_ptr_smr_block<T>::deleteBlock
+};
+
+
+//=============================================================================
+// atomic_ptr_smr -- smr deferred reclamation of atomic_ptr_ref objects
+//
+//=============================================================================
+template<typename T> class atomic_ptr_smr {
+	public:
+
+		//-----------------------------------------------------------------
+		// make -- make_local w/ smr deferred reclamation
+		//-----------------------------------------------------------------
+		template<typename... Args> static local_ptr<T> make(Args&&... args) {
+			local_ptr<T> temp(new atomic_ptr_smr_block<T>(std::forward<Args>(args)...));
+			temp.setPool(&put);
+			return temp;
+		}
+
+	private:
+
+		//-----------------------------------------------------------------
+		// put -- defer delete of ref w/ zero refcounts (pool_put_t)
+		//
+		// arg is the ref itself so smr_scan matches it against hazard
+		// pointers.
+		//-----------------------------------------------------------------
+		static void put(void * ref) {
+			atomic_ptr_smr_block<T> * block = static_cast<atomic_ptr_smr_block<T> *>((atomic_ptr_ref<T> *)ref);
+			rcu_defer_t * work = &block->defer;
+
+			work->func = &reclaim;
+			work->arg = ref;
+			work->forrefs = NULL;
+			work->type = fifo;
+			work->psequence = &(work->sequence);	// no fifo ordering w/ other refs
+
+			smr_defer(work);
+		}
+
+		static void reclaim(void * ref) {
+			local_ptr<T> temp((atomic_ptr_ref<T> *)ref);	// refcount {1, 0}
+			temp.setPool(nullptr);		// delete on dtor
+		}
+
+}; // class atomic_ptr_smr
+
+
+//
+// per thread free list of hazard pointers for guards
+//
+struct atomic_ptr_hazards {
+	std::vector<smr_t *>	pairs;		// from fastsmr, in acquire order
+	std::vector<smr_t *>	free;		// unused hazard pointers, null
+
+	static atomic_ptr_hazards & local() {
+		static thread_local atomic_ptr_hazards hazards;
+		return hazards;
+	}
+
+	smr_t * get() {
+		smr_t *	hptr;
+
+		if (free.empty()) {				// another pair
+			if ((hptr = smr_acquire()) == NULL)
+				abort();
+			pairs.push_back(hptr);
+			free.push_back(&hptr[1]);
+			return &hptr[0];
+		}
+
+		hptr = free.back();
+		free.pop_back();
+		return hptr;
+	}
+
+	void put(smr_t * hptr) {
+		atomic_store_explicit(hptr, (smr_t)nullptr, memory_order_release);
+		free.push_back(hptr);
+	}
+
+	//-----------------------------------------------------------------
+	// release -- give the thread's pairs back to fastsmr, no guards
+	// may be live
+	//-----------------------------------------------------------------
+	static void release() {
+		atomic_ptr_hazards & hazards = local();
+
+		if (hazards.free.size() != 2 * hazards.pairs.size())
+			abort();					// guards still live
+
+		while (!hazards.pairs.empty()) {	// smr_dealloc is lifo
+			smr_dealloc(hazards.pairs.back());
+			hazards.pairs.pop_back();
+		}
+		hazards.free.clear();
+	}
+};
+
+
+//=============================================================================
+// atomic_ptr_guard -- hazard pointer protected read of an atomic_ptr
+//
+//=============================================================================
+template<typename T, template<typename> class R = differentialReference, typename O = ordering::acquire_loads> class atomic_ptr_guard {
+	public:
+
+		atomic_ptr_guard(atomic_ptr<T, R, O> & src) {
+			atomic_ptr_ref<T> * temp;
+
+			owner = &atomic_ptr_hazards::local();
+			hptr = owner->get();
+
+			// set hazard pointer and verify atomic_ptr unchanged
+			refptr = src.ref.peek(O::load);
+			do {
+				temp = refptr;
+				atomic_store_explicit(hptr, (smr_t)temp, memory_order_relaxed);
+				refptr = src.ref.peek(O::load);
+			}
+			while (refptr != temp);
+		}
+
+		atomic_ptr_guard(atomic_ptr_guard && src) {	// move constructor
+			owner = src.owner;
+			hptr = src.hptr;
+			refptr = src.refptr;
+			src.hptr = nullptr;
+			src.refptr = nullptr;
+		}
+
+		~atomic_ptr_guard() {
+			if (hptr != nullptr) {
+				if (owner != &atomic_ptr_hazards::local())
+					abort();					// hazard pointer belongs to another thread
+				owner->put(hptr);
+			}
+		}
+
+		T * get() {
+			return (refptr != nullptr) ? atomic_load_explicit(&refptr->ptr, memory_order_relaxed) : (T *)nullptr;
+		}
+
+		T * operator -> () { return get(); }
+		T & operator * () { return *get(); }
+
+		bool operator == (T * rhd) { return (rhd == get() ); }
+		bool operator != (T * rhd) { return (rhd != get() ); }
+
+		//-----------------------------------------------------------------
+		// promote -- local_ptr to guarded object, null if object is
+		// being reclaimed
+		//-----------------------------------------------------------------
+		local_ptr<T> promote() {
+			local_ptr<T> temp;
+
+			if (refptr != nullptr && refptr->tryacquire())
+				temp.adopt(refptr);
+
+			return temp;
+		}
+
+	private:
+		void * operator new (size_t);		// auto only
+		atomic_ptr_guard(const atomic_ptr_guard &);
+		atomic_ptr_guard & operator = (const atomic_ptr_guard &);
+
+		atomic_ptr_hazards * owner;			// making thread's free list
+		smr_t *	hptr;						// hazard pointer
+		atomic_ptr_ref<T> * refptr;			// guarded ref
+
+}; // class atomic_ptr_guard
+
+
+//-----------------------------------------------------------------------------
+// borrow -- guarded read of atomic_ptr
+//-----------------------------------------------------------------------------
+template<typename T, template<typename> class R, typename O> inline atomic_ptr_guard<T, R, O> borrow(atomic_ptr<T, R, O> & src) {
+	return atomic_ptr_guard<T, R, O>(src);
+}
+
+#endif // _ATOMIC_PTR_SMR_H
+
+
+/*-*/
@@ -0,0 +1,258 @@
+/*
+   Copyright 2002-2013 Joseph W. Seigh
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+//------------------------------------------------------------------------------
+// atomic_weak_ptr -- weak references for atomic_ptr
+//
+// version -- 0.0.x (pre-alpha)
+//
+//
+// Weak references don't keep the object alive.  The object is destroyed
+// when the strong reference counts go to zero but the atomic_ptr_ref is
+// kept until the weak reference counts also go to zero, so a weak
+// reference can always safely try to promote itself to a local_ptr.
+//
+// The weak counts are a second differential refcount in atomic_ptr_ref.
+// local_weak_ptr references are ephemeral counts and atomic_weak_ptr
+// links are reference counts, same as for local_ptr and atomic_ptr.  All
+// of the strong references together hold one weak link reference which
+// is dropped when the object is destroyed.
+//
+// lock() promotes to a local_ptr only if the strong counts are non zero
+// and returns null otherwise.  It's lock-free.
+//
+// Refs w/ a recycle pool (atomic_ptr_pool, atomic_ptr_smr) recycle the
+// object along w/ the ref and can't be used w/ weak references.
+//
+// memory visibility:
+//   Same as atomic_ptr for loads and stores of atomic_weak_ptr.  A
+// successful lock() has the same visibility as loading a local_ptr from
+// an atomic_ptr.
+//
+//------------------------------------------------------------------------------
+
+#ifndef _ATOMIC_WEAK_PTR_H
+#define _ATOMIC_WEAK_PTR_H
+
+#include <atomic_ptr.h>
+
+//=============================================================================
+// local_weak_ptr
+//
+//
+//=============================================================================
+template<typename T> class local_weak_ptr {
+	friend class atomic_weak_ptr<T>;
+	public:
+
+		local_weak_ptr() {
+			refptr = nullptr;
+		}
+
+		local_weak_ptr(const local_ptr<T> & src) {
+			if ((refptr = src.refptr) != nullptr) {
+				atomic_store_explicit(&refptr->weak, true, memory_order_relaxed);
+				refptr->adjustWeak(+1, 0);
+			}
+			src.unique = false;				// lock() can add references
+		}
+
+		template<template<typename> class R, typename O> local_weak_ptr(atomic_ptr<T, R, O> & src) {
+			local_ptr<T> temp(src);
+			if ((refptr = temp.refptr) != nullptr) {
+				atomic_store_explicit(&refptr->weak, true, memory_order_relaxed);
+				refptr->adjustWeak(+1, 0);
+			}
+		}
+
+		local_weak_ptr(const local_weak_ptr<T> & src) {
+			if ((refptr = src.refptr) != nullptr)
+				refptr->adjustWeak(+1, 0);
+		}
+
+		local_weak_ptr(local_weak_ptr<T> && src) {	// move constructor
+			refptr = src.refptr;
+			src.refptr = nullptr;
+		}
+
+		local_weak_ptr(atomic_weak_ptr<T> & src) {
+			refptr = src.ref.acquire();		// atomic
+		}
+
+		~local_weak_ptr() {
+			if (refptr != nullptr && refptr->adjustWeak(-1, 0) == 0)
+				refptr->release();
+		}
+
+		local_weak_ptr<T> & operator = (const local_ptr<T> & src) {
+			local_weak_ptr<T> temp(src);
+			swap(temp);	// non-atomic
+			return *this;
+		}
+
+		local_weak_ptr<T> & operator = (const local_weak_ptr<T> & src) {
+			local_weak_ptr<T> temp(src);
+			swap(temp);	// non-atomic
+			return *this;
+		}
+
+		local_weak_ptr<T> & operator = (local_weak_ptr<T> && src) {
+			local_weak_ptr<T> temp(std::move(src));
+			swap(temp);	// non-atomic
+			return *this;
+		}
+
+		local_weak_ptr<T> & operator = (atomic_weak_ptr<T> & src) {
+			local_weak_ptr<T> temp(src);
+			swap(temp);	// non-atomic
+			return *this;
+		}
+
+		//-----------------------------------------------------------------
+		// lock -- local_ptr to object, null if object destroyed
+		//-----------------------------------------------------------------
+		local_ptr<T> lock() {
+			local_ptr<T> temp;
+
+			if (refptr != nullptr && refptr->tryacquire())
+				temp.adopt(refptr);
+
+			return temp;
+		}
+
+		//-----------------------------------------------------------------
+		// expired -- object destroyed.  A hint only; lock() may still
+		// fail if this returns false.
+		//-----------------------------------------------------------------
+		bool expired() {
+			return (refptr == nullptr || atomic_load_explicit(&refptr->ptr, memory_order_relaxed) == nullptr);
+		}
+
+		bool operator == (local_weak_ptr<T> & rhd) { return (refptr == rhd.refptr); }
+		bool operator != (local_weak_ptr<T> & rhd) { return (refptr != rhd.refptr); }
+
+	private:
+		void * operator new (size_t);		// auto only
+
+		atomic_ptr_ref<T> * refptr;
+
+		inline void swap(local_weak_ptr & other) { // non-atomic swap
+			atomic_ptr_ref<T> * temp;
+			temp = refptr;
+			refptr = other.refptr;
+			other.refptr = temp;
+		}
+
+}; // class local_weak_ptr
+
+
+//=============================================================================
+// atomic_weak_ptr
+//
+//
+//=============================================================================
+template<typename T> class atomic_weak_ptr {
+	friend class local_weak_ptr<T>;
+
+	protected:
+		differentialReference<T>  ref;
+
+	public:
+
+		atomic_weak_ptr() {
+			ref.init(nullptr);
+		}
+
+		atomic_weak_ptr(const local_ptr<T> & src) {
+			ref.init(src.refptr);
+			if (src.refptr != nullptr) {
+				atomic_store_explicit(&src.refptr->weak, true, memory_order_relaxed);
+				src.refptr->adjustWeak(0, +1);
+			}
+			src.unique = false;				// lock() can add references
+		}
+
+		atomic_weak_ptr(const local_weak_ptr<T> & src) {	// copy constructor
+			ref.init(src.refptr);
+			if (src.refptr != nullptr)
+				src.refptr->adjustWeak(0, +1);
+		}
+
+		atomic_weak_ptr(local_weak_ptr<T> && src) {	// move constructor
+			ref.init(src.refptr);
+			if (src.refptr != nullptr)
+				src.refptr->adjustWeak(-1, +1);
+			src.refptr = nullptr;
+		}
+
+		atomic_weak_ptr(atomic_weak_ptr<T> & src) {	// copy constructor
+			atomic_ptr_ref<T> * refptr;
+
+			refptr = src.ref.acquire();	// atomic
+			ref.init(refptr);
+			if (refptr != nullptr)
+				refptr->adjustWeak(-1, +1);
+		}
+
+		~atomic_weak_ptr() {
+			atomic_ptr_ref<T> * refptr = ref.getptr();
+
+			if (refptr != nullptr && refptr->adjustWeak(ref.getecount(), -1) == 0)
+				refptr->release();
+		}
+
+		atomic_weak_ptr & operator = (const local_ptr<T> & src) {
+			atomic_weak_ptr<T> temp(src);
+			swap(temp);					// atomic
+			return *this;
+		}
+
+		atomic_weak_ptr & operator = (const local_weak_ptr<T> & src) {
+			atomic_weak_ptr<T> temp(src);
+			swap(temp);					// atomic
+			return *this;
+		}
+
+		atomic_weak_ptr & operator = (local_weak_ptr<T> && src) {
+			atomic_weak_ptr<T> temp(std::move(src));
+			swap(temp);					// atomic
+			return *this;
+		}
+
+		atomic_weak_ptr & operator = (atomic_weak_ptr<T> & src) {
+			atomic_weak_ptr<T> temp(src);
+			swap(temp);					// atomic
+			return *this;
+		}
+
+		local_weak_ptr<T> load() { return local_weak_ptr<T>(*this); }
+
+		//-----------------------------------------------------------------
+		// lock -- local_ptr to current object, null if none or destroyed
+		//-----------------------------------------------------------------
+		local_ptr<T> lock() { return local_weak_ptr<T>(*this).lock(); }
+
+		// atomic
+		void swap(atomic_weak_ptr<T> & obj) {	// obj is local & non-shared
+			ref.exchange(obj.ref);
+		}
+
+}; // class atomic_weak_ptr
+
+#endif // _ATOMIC_WEAK_PTR_H
+
+
+/*-*/
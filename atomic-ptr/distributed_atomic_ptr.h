@@ -0,0 +1,234 @@
+/*
+   Copyright 2002-2013 Joseph W. Seigh
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+//------------------------------------------------------------------------------
+// distributed_atomic_ptr -- atomic_ptr striped per cpu for read scaling
+//
+// version -- 0.0.x (pre-alpha)
+//
+//
+// Every load from an atomic_ptr is an interlocked update of its
+// differential reference, and every local_ptr drop an interlocked
+// update of the ref's refcount, so readers of a single hot atomic_ptr
+// serialize on those cache lines.  distributed_atomic_ptr keeps one
+// atomic_ptr (stripe) per cpu, each on its own cache line and each
+// holding its own stripe ref to the object.  Readers load from the
+// stripe for the cpu they are running on, or for a caller supplied
+// hint, and only touch that stripe and its ref.
+//
+// A stripe ref holds one link reference on the stored object's ref
+// (the root) and drops it when its own refcounts go to zero.  Stores
+// take all the root references w/ a single refcount update, make a
+// new stripe ref per stripe and swap them in.  The ephemeral counts
+// acquired through a stripe are reconciled into that stripe's ref when
+// it is swapped out, same as for atomic_ptr.  Stores are serialized w/
+// a mutex, held only for the swaps, so concurrent stores can't leave
+// stripes referencing different objects.
+//
+// local_ptrs loaded from different stripes reference the same object
+// through different refs, so they compare equal by get() but not by
+// local_ptr ==, and a weak reference made from one expires w/ its
+// stripe ref rather than w/ the object.
+//
+// memory visibility:
+//   Same as atomic_ptr for each stripe.  While a store is in progress
+// readers on different stripes may see the old and new values, i.e.
+// loads from different cpus are not ordered w/ respect to each other.
+//
+//------------------------------------------------------------------------------
+
+#ifndef _DISTRIBUTED_ATOMIC_PTR_H
+#define _DISTRIBUTED_ATOMIC_PTR_H
+
+#include <sched.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <vector>
+#include <atomic_ptr.h>
+
+#define STRIPE_CACHE_LINE 64
+
+//=============================================================================
+// distributed_atomic_ptr_ref -- per stripe ref to the object of a root
+// ref, holds one root link reference
+//=============================================================================
+template<typename T> class distributed_atomic_ptr_ref : public atomic_ptr_ref<T> {
+	public:
+
+		//-----------------------------------------------------------------
+		// make -- n stripe refs to src's object, refs[j] gets the only
+		// reference to each.  Null if src is null.
+		//-----------------------------------------------------------------
+		static void make(local_ptr<T> & src, local_ptr<T> * refs, int n) {
+			atomic_ptr_ref<T> * root = src.refptr;
+
+			if (root == nullptr)
+				return;
+
+			root->adjust(0, +n);			// all stripes' root links at once
+			for (int j = 0; j < n; j++)
+				refs[j].recycle(new distributed_atomic_ptr_ref<T>(root));	// refcount {1, 0}
+		}
+
+	private:
+		atomic_ptr_ref<T> *	root;			// holds one link reference
+
+		distributed_atomic_ptr_ref(atomic_ptr_ref<T> * src) : atomic_ptr_ref<T>(src->ptr) {
+			this->ops = &stripeOps;
+			root = src;
+		}
+
+		static const typename atomic_ptr_ref<T>::ops_t stripeOps;
+
+		// drop the root link, object is destroyed w/ the root
+		static void dropRoot(atomic_ptr_ref<T> * ref, T *) {
+			atomic_ptr_ref<T> * root = static_cast<distributed_atomic_ptr_ref<T> *>(ref)->root;
+
+			if (root->adjust_mb(0, -1, memory_order_release) == 0) {
+				atomic_thread_fence(memory_order_acquire);
+				root->dispose();
+			}
+		}
+
+		static void deleteStripe(atomic_ptr_ref<T> * ref) {
+			delete static_cast<distributed_atomic_ptr_ref<T> *>(ref);
+		}
+
+}; // class distributed_atomic_ptr_ref
+
+template<typename T> const typename atomic_ptr_ref<T>::ops_t distributed_atomic_ptr_ref<T>::stripeOps = {
+	&distributed_atomic_ptr_ref<T>::dropRoot,
+	&distributed_atomic_ptr_ref<T>::deleteStripe
+};
+
+
+//=============================================================================
+// distributed_atomic_ptr
+//
+//=============================================================================
+template<typename T, template<typename> class R = differentialReference, typename O = ordering::acquire_loads> class distributed_atomic_ptr {
+	public:
+
+		distributed_atomic_ptr(T * obj = nullptr, int n = 0) {
+			init(n);
+			local_ptr<T> temp(obj);
+			store(temp);
+		}
+
+		distributed_atomic_ptr(local_ptr<T> & src, int n = 0) {
+			init(n);
+			store(src);
+		}
+
+		~distributed_atomic_ptr() {
+			for (int j = 0; j < nstripes; j++)
+				stripes[j].~stripe_t();
+			free(stripes);
+			pthread_mutex_destroy(&mutex);
+		}
+
+		//-----------------------------------------------------------------
+		// store -- replace all stripes
+		//
+		// Stripe refs are made before taking the mutex, and the old ones
+		// dropped after releasing it.
+		//-----------------------------------------------------------------
+		void store(local_ptr<T> & src) {
+			std::vector<local_ptr<T>> refs(nstripes);
+			distributed_atomic_ptr_ref<T>::make(src, refs.data(), nstripes);
+
+			std::vector<atomic_ptr<T, R, O>> old(nstripes);
+			for (int j = 0; j < nstripes; j++)
+				old[j] = std::move(refs[j]);	// only reference, no refcount update
+
+			pthread_mutex_lock(&mutex);
+			for (int j = 0; j < nstripes; j++)
+				stripes[j].ptr.swap(old[j]);	// atomic
+			pthread_mutex_unlock(&mutex);
+		}
+
+		void store(local_ptr<T> && src) {
+			local_ptr<T> temp(std::move(src));
+			store(temp);
+		}
+
+		distributed_atomic_ptr & operator = (local_ptr<T> & src) {
+			store(src);
+			return *this;
+		}
+
+		distributed_atomic_ptr & operator = (local_ptr<T> && src) {
+			store(std::move(src));
+			return *this;
+		}
+
+		distributed_atomic_ptr & operator = (T * obj) {
+			store(local_ptr<T>(obj));
+			return *this;
+		}
+
+		//-----------------------------------------------------------------
+		// load -- load from current cpu's stripe or hinted stripe
+		//-----------------------------------------------------------------
+		local_ptr<T> load() {
+			int cpu = sched_getcpu();
+			return local_ptr<T>(stripe(cpu < 0 ? 0 : cpu));
+		}
+
+		local_ptr<T> load(unsigned int hint) {
+			return local_ptr<T>(stripe(hint));
+		}
+
+		inline local_ptr<T> operator -> () { return load(); }
+		inline local_ptr<T> operator * () { return load(); }
+
+		int getStripes() { return nstripes; }
+
+	private:
+		struct alignas(STRIPE_CACHE_LINE) stripe_t {
+			atomic_ptr<T, R, O>	ptr;
+		};
+
+		stripe_t *		stripes;
+		int				nstripes;
+		pthread_mutex_t	mutex;				// serializes stores
+
+		void init(int n) {
+			if (n <= 0 && (n = (int)sysconf(_SC_NPROCESSORS_CONF)) <= 0)
+				n = 1;
+			nstripes = n;
+
+			if (posix_memalign((void **)&stripes, STRIPE_CACHE_LINE, n * sizeof(stripe_t)) != 0)
+				abort();
+			for (int j = 0; j < n; j++)
+				new (&stripes[j]) stripe_t();
+
+			pthread_mutex_init(&mutex, NULL);
+		}
+
+		inline atomic_ptr<T, R, O> & stripe(unsigned int ndx) {
+			return stripes[ndx % nstripes].ptr;
+		}
+
+		distributed_atomic_ptr(const distributed_atomic_ptr &);	// not copyable
+		distributed_atomic_ptr & operator = (const distributed_atomic_ptr &);
+
+}; // class distributed_atomic_ptr
+
+#endif // _DISTRIBUTED_ATOMIC_PTR_H
+
+
+/*-*/
@@ -0,0 +1,77 @@
+/*
+Copyright 2005, 2006 Joseph W. Seigh
+
+Permission to use, copy, modify and distribute this software
+and its documentation for any purpose and without fee is
+hereby granted, provided that the above copyright notice
+appear in all copies, that both the copyright notice and this
+permission notice appear in supporting documentation.  I make
+no representations about the suitability of this software for
+any purpose. It is provided "as is" without express or implied
+warranty.
+
+---
+*/
+
+//------------------------------------------------------------------------------
+// atomix.h -- atomic loads and stores and hazard pointer loads for fastsmr,
+//   gcc __atomic builtins
+//
+// version -- 0.0.1 (pre-alpha)
+//
+// smrload sets a hazard pointer and reloads the source until it's stable
+// w/o a store/load membar.  The store only has to be seen by smr_scan,
+// which runs after every thread has passed a quiesce point (qcount.h).
+//
+//------------------------------------------------------------------------------
+
+#ifndef FASTSMR_ATOMIX_H
+#define FASTSMR_ATOMIX_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef atomic_load
+#define atomic_load(p) __atomic_load_n(p, __ATOMIC_RELAXED)
+#define atomic_store(p, v) __atomic_store_n(p, v, __ATOMIC_RELAXED)
+#endif
+
+#define atomic_load_acq(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define atomic_store_rel(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+
+#define rmb() __atomic_thread_fence(__ATOMIC_ACQUIRE)		// load/load
+#define wmb() __atomic_thread_fence(__ATOMIC_RELEASE)		// store/store
+#define cmb() __atomic_signal_fence(__ATOMIC_SEQ_CST)		// compiler only
+
+
+//------------------------------------------------------------------------------
+// smrload -- load *src into hazard pointer hptr, returns the value
+//
+//   Dependent loads through the value are ordered after it.
+//------------------------------------------------------------------------------
+#define smrload(hptr, src) ({ \
+		__typeof__(*(src)) _p, _q; \
+		_p = __atomic_load_n(src, __ATOMIC_CONSUME); \
+		do { \
+			_q = _p; \
+			__atomic_store_n((hptr), (smr_t)_q, __ATOMIC_RELAXED); \
+			cmb(); \
+			_p = __atomic_load_n(src, __ATOMIC_CONSUME); \
+		} \
+		while (_p != _q); \
+		_p; \
+	})
+
+//------------------------------------------------------------------------------
+// smrnull -- clear hazard pointer, release so prior loads through it are done
+//------------------------------------------------------------------------------
+#define smrnull(hptr) __atomic_store_n((hptr), (smr_t)0, __ATOMIC_RELEASE)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FASTSMR_ATOMIX_H */
+
+/*-*/
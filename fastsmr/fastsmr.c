@@ -39,24 +39,12 @@ warranty.
 //------------------------------------------------------------------------------
 pthread_mutex_t rcu_poll_mutex = PTHREAD_MUTEX_INITIALIZER;
 
-pthread_mutex_t rcu_mutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_cond_t	rcu_cvar = PTHREAD_COND_INITIALIZER;
+smr_domain_t	rcu_default;		// default domain, rcu_startup
 
-rcu_stats_t	stats;					// rcu statistics
-
-fifo_t		ready_queue = FIFO_INITIALIZER;	// ready work
-utime_t		rcu_minWait = 50000;	// minimum time to wait	(usec)
-
-
-//=============================================================
-
-
-pthread_t	rcu_poll_id;			// rcu polling thread
-int			deferred_work = 0;
-
-qcount_t	qcobj;					// qcount object
-
-int			rcu_stop = 0;			// shutdown flag 0|1
+#define RCU_WAIT_MIN	100			// adaptive poll interval floor (usec)
+#define RCU_WAIT_FORCED	1000		// floor w/ membarrier qcount_set (usec)
+#define RCU_WORKER_BATCH	256		// default max callbacks per worker batch
+#define RCU_WORKER_SLICE	1000	// target worker batch time (usec)
 
 
 //=============================================================
@@ -64,13 +52,17 @@ int			rcu_stop = 0;			// shutdown flag 0|1
 
 
 void *rcu_poll(void *z);			// forward declare
+static void rcu_sync_start(smr_domain_t *);
+static void rcu_sync_cb(void *);
+static void rcu_sync_refs(void *, refcb_t);
+static void rcu_stopworkers(smr_domain_t *);
 
 
 //------------------------------------------------------------------------------
 // rcu_startpoll -- start polling thread
 //
 //------------------------------------------------------------------------------
-pthread_t rcu_startpoll() {
+pthread_t rcu_startpoll(smr_domain_t *d) {
 	pthread_attr_t	attr;
 	int		rc;
 
@@ -78,9 +70,84 @@ pthread_t rcu_startpoll() {
 	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
 	pthread_attr_setscope(&attr, PTHREAD_SCOPE_SYSTEM);
 
-	rc = pthread_create(&rcu_poll_id, &attr, &rcu_poll, NULL);
+	rc = pthread_create(&d->rcu_poll_id, &attr, &rcu_poll, d);
 
-	return rcu_poll_id;
+	return d->rcu_poll_id;
+}
+
+
+//------------------------------------------------------------------------------
+// rcu_init -- initialize domain
+//
+//------------------------------------------------------------------------------
+static void rcu_init(smr_domain_t *d) {
+
+	memset(d, 0, sizeof(smr_domain_t));
+	pthread_mutex_init(&d->rcu_mutex, NULL);
+	pthread_cond_init(&d->rcu_cvar, NULL);
+	pthread_cond_init(&d->sync_cvar, NULL);
+	pthread_cond_init(&d->worker_cvar, NULL);
+	fifo_init(&d->ready_queue);
+	fifo_init(&d->worker_queue);
+	d->rcu_minWait = 50000;
+	d->rcu_targetLatency = 0;
+	d->rcu_maxBacklog = 0;
+	d->gp_start = 0;
+	d->deferred_work = 0;
+	d->rcu_stop = 0;
+	d->rcu_idle = 0;
+
+	d->sync_work.func = &rcu_sync_cb;
+	d->sync_work.arg = d;
+	d->sync_work.forrefs = &rcu_sync_refs;
+	d->sync_work.type = trace;
+	d->sync_started = 0;
+	d->sync_done = 0;
+	d->sync_wanted = 0;
+	d->barrier_gen = 1;
+	d->barrier_done = 0;
+	d->rcu_workers = 0;
+	d->worker_batch = RCU_WORKER_BATCH;
+	d->worker_stop = 0;
+	d->worker_ids = NULL;
+
+	if (qcount_init(&d->qcobj) != 0)
+		abort();
+	d->rcu_waitFloor = qcount_forced(d->qcobj) ? RCU_WAIT_FORCED : RCU_WAIT_MIN;
+	d->qcount_time = 0;
+	smr_startup(d);
+}
+
+
+//------------------------------------------------------------------------------
+// rcu_fini -- stop domain's polling thread and free its resources
+//
+//------------------------------------------------------------------------------
+static void rcu_fini(smr_domain_t *d) {
+
+	smr_domain_flush(d);
+
+	if (smr_check(d) != 0) {
+		abort();
+	}
+
+	pthread_mutex_lockx(&d->rcu_mutex);
+	d->rcu_stop = 1;
+	pthread_cond_broadcast(&d->rcu_cvar);
+	pthread_mutex_unlockx(&d->rcu_mutex);
+
+	pthread_join(d->rcu_poll_id, NULL);
+
+	// polling thread exits w/ no deferred work, worker queue is empty
+	rcu_stopworkers(d);
+
+	// deallocate RCU nodes if necessary
+	rcu_shutdown2(d);
+
+	// cleanup here
+	qcount_destroy(&d->qcobj);
+
+	return;
 }
 
 
@@ -90,10 +157,8 @@ pthread_t rcu_startpoll() {
 //------------------------------------------------------------------------------
 pthread_t rcu_startup() {
 
-	qcount_init(&qcobj);
-	smr_startup();
-	memset(&stats, 0, sizeof(stats));
-	return rcu_startpoll();
+	rcu_init(&rcu_default);
+	return rcu_startpoll(&rcu_default);
 }
 
 
@@ -102,74 +167,338 @@ pthread_t rcu_startup() {
 //
 //------------------------------------------------------------------------------
 void rcu_shutdown() {
+	rcu_fini(&rcu_default);
+}
 
-	if (smr_check() != 0) {
-		abort();
+
+//------------------------------------------------------------------------------
+// smr_domain_create -- create and start domain
+//
+//------------------------------------------------------------------------------
+smr_domain_t * smr_domain_create() {
+	smr_domain_t	*d;
+
+	if ((d = (smr_domain_t *)malloc(sizeof(smr_domain_t))) == NULL)
+		return NULL;
+
+	rcu_init(d);
+	rcu_startpoll(d);
+
+	return d;
+}
+
+
+//------------------------------------------------------------------------------
+// smr_domain_destroy -- shutdown and free domain
+//
+//   Waits for every other thread that acquired hazard pointers or
+//   deferred work in the domain to exit or call smr_domain_release.  The
+//   calling thread is released here.
+//------------------------------------------------------------------------------
+void smr_domain_destroy(smr_domain_t *d) {
+
+	smr_domain_release(d);
+	smr_shutdown(d);
+	rcu_fini(d);
+
+	pthread_key_delete(d->smr_key);
+	free(d->hptr);
+	free(d->sync_snap);
+	pthread_cond_destroy(&d->sync_cvar);
+	pthread_cond_destroy(&d->worker_cvar);
+	pthread_cond_destroy(&d->rcu_cvar);
+	pthread_mutex_destroy(&d->rcu_mutex);
+	free(d);
+}
+
+
+//------------------------------------------------------------------------------
+// smr_domain_default --
+//------------------------------------------------------------------------------
+smr_domain_t * smr_domain_default() {
+	return &rcu_default;
+}
+
+
+//-----------------------------------------------------------------------------
+// rcu_graceperiod -- deferred work made ready, adjust poll interval
+//
+//   Grace period latency is approximate, the time since work arrived w/
+//   none outstanding or since the last grace period.  The interval is
+//   cut by a quarter if it's over target and grown by a quarter if it's
+//   under half the target.
+//-----------------------------------------------------------------------------
+static void rcu_graceperiod(smr_domain_t *d) {
+	utime_t	now = getutimeofday();
+	utime_t	gp;
+
+	if (d->gp_start != 0) {
+		gp = now - d->gp_start;
+		d->stats.gplast = gp;
+		if (gp > d->stats.gpmax)
+			d->stats.gpmax = gp;
+
+		if (d->rcu_targetLatency != 0) {
+			if (gp > d->rcu_targetLatency) {
+				d->rcu_wait -= d->rcu_wait / 4;
+				d->stats.shortens++;
+			}
+			else if (gp < d->rcu_targetLatency / 2) {
+				d->rcu_wait += d->rcu_wait / 4 + 1;
+				d->stats.lengthens++;
+			}
+
+			if (d->rcu_wait < d->rcu_waitFloor)
+				d->rcu_wait = d->rcu_waitFloor;
+			if (d->rcu_wait > d->rcu_targetLatency)
+				d->rcu_wait = d->rcu_targetLatency;
+		}
 	}
 
-	pthread_mutex_lockx(&rcu_mutex);
-	rcu_stop = 1;
-	pthread_cond_broadcast(&rcu_cvar);
-	pthread_mutex_unlockx(&rcu_mutex);
+	d->gp_start = (d->deferred_work > 0) ? now : 0;
+}
 
-	pthread_join(rcu_poll_id, NULL);
 
-	// deallocate RCU nodes if necessary
-	rcu_shutdown2();
+//-----------------------------------------------------------------------------
+// rcu_pollwait -- time to wait for quiesce points
+//
+//   Fixed rcu_minWait unless targets are set.  Otherwise the interval
+//   for the target latency, scaled down linearly as deferred work grows
+//   toward the max backlog, and the floor at or over it.  The floor is
+//   higher w/ the membarrier qcount backend, each poll is an IPI to
+//   every cpu running the process.
+//-----------------------------------------------------------------------------
+static utime_t rcu_pollwait(smr_domain_t *d) {
+	utime_t	wait;
+	int		backlog = d->deferred_work;
+	int		max = d->rcu_maxBacklog;
+
+	if (d->rcu_targetLatency == 0)
+		return d->rcu_minWait;
+
+	wait = d->rcu_wait;
+	if (max > 0) {
+		if (backlog >= max) {
+			wait = d->rcu_waitFloor;
+			d->stats.backlogged++;
+		}
+		else
+			wait = wait * (max - backlog) / max;
+	}
 
-	// cleanup here
-	qcount_destroy(&qcobj);
+	if (wait < d->rcu_waitFloor)
+		wait = d->rcu_waitFloor;
 
-	return;
+	d->stats.wait = wait;
+	return wait;
+}
+
+
+//-----------------------------------------------------------------------------
+// rcu_barrier_done -- close out smr_barrier epochs w/ no outstanding work
+//
+//   Called w/ rcu_mutex held.
+//-----------------------------------------------------------------------------
+static void rcu_barrier_done(smr_domain_t *d) {
+	int		n = 0;
+
+	while (d->barrier_done + 1 != d->barrier_gen
+		&& d->barrier_count[(d->barrier_done + 1) & 1] == 0) {
+		d->barrier_done++;
+		n++;
+	}
+
+	if (n > 0)
+		pthread_cond_broadcast(&d->sync_cvar);
+}
+
+
+//-----------------------------------------------------------------------------
+// rcu_workdone -- account for work performed w/ rcu_mutex held
+//-----------------------------------------------------------------------------
+static void rcu_workdone(smr_domain_t *d, int workcount, int epochcount[2]) {
+	d->stats.undefers += workcount;
+	d->deferred_work -= workcount;
+	d->barrier_count[0] -= epochcount[0];
+	d->barrier_count[1] -= epochcount[1];
 }
 
 
 //-----------------------------------------------------------------------------
 // process_work --
+//
+//   Ready work is run inline, or handed to the worker pool if there
+//   is one.  Worker pool work stays in deferred_work until it's run.
+//-----------------------------------------------------------------------------
+void process_work(smr_domain_t *d) {
+	rcu_defer_t	*work;
+	rcu_defer_t	*workqueue;
+	int			workcount;			// count of work performed
+	int			epochcount[2];		// work performed by barrier epoch parity
+	utime_t		t0;
+
+	if (d->rcu_workers > 0) {
+		if (d->ready_queue.tail != NULL) {
+			fifo_requeue(&d->worker_queue, &d->ready_queue);
+			d->stats.handoffs++;
+			pthread_cond_broadcast(&d->worker_cvar);
+		}
+	}
+
+	else {
+		while ((workqueue = fifo_dequeueall(&d->ready_queue)) != NULL) {
+
+			pthread_mutex_unlockx(&d->rcu_mutex);
+
+			t0 = getutimeofday();
+			workcount = 0;
+			epochcount[0] = epochcount[1] = 0;
+			while ((work = workqueue) != NULL) {
+				workcount++;
+				epochcount[work->barrier & 1]++;
+				workqueue = work->next;		// dequeue
+				work->func(work->arg);
+			}
+
+			pthread_mutex_lockx(&d->rcu_mutex);
+			d->stats.cbtime += getutimeofday() - t0;
+			rcu_workdone(d, workcount, epochcount);
+		}
+	}
+
+	rcu_barrier_done(d);
+	rcu_graceperiod(d);
+
+	return;
+}
+
+
+//-----------------------------------------------------------------------------
+// rcu_worker -- callback worker thread
+//
+//   Each worker sizes its batches to about RCU_WORKER_SLICE usecs at
+//   the callback rate it last saw, so slow callbacks spread across the
+//   pool and fast ones take rcu_mutex less often.
 //-----------------------------------------------------------------------------
-void process_work() {
+static void *rcu_worker(void *z) {
+	smr_domain_t	*d = (smr_domain_t *)z;
 	rcu_defer_t	*work;
 	rcu_defer_t	*workqueue;
 	int			workcount;			// count of work performed
+	int			epochcount[2];		// work performed by barrier epoch parity
+	int			batch;				// this worker's batch size
+	int			next;
+	utime_t		t0, t1, now;
+	utime_t		cbmax;				// longest callback in batch
 
-	while ((workqueue = fifo_dequeueall(&ready_queue)) != NULL) {
+	smr_service = 1;
+	pthread_mutex_lockx(&d->rcu_mutex);
+	batch = d->worker_batch;
 
-		pthread_mutex_unlockx(&rcu_mutex);
+	for (;;) {
+
+		if (d->worker_queue.tail == NULL) {
+			if (d->worker_stop)
+				break;
+			pthread_cond_wait(&d->worker_cvar, &d->rcu_mutex);
+			continue;
+		}
+
+		workqueue = fifo_dequeuen(&d->worker_queue, batch, &workcount);
 
-		workcount = 0;
+		pthread_mutex_unlockx(&d->rcu_mutex);
+
+		epochcount[0] = epochcount[1] = 0;
+		cbmax = 0;
+		t0 = t1 = getutimeofday();
 		while ((work = workqueue) != NULL) {
-			workcount++;
+			epochcount[work->barrier & 1]++;
 			workqueue = work->next;		// dequeue
 			work->func(work->arg);
+
+			now = getutimeofday();
+			if (now - t1 > cbmax)
+				cbmax = now - t1;
+			t1 = now;
 		}
 
-		pthread_mutex_lockx(&rcu_mutex);
-		stats.undefers += workcount;
-		deferred_work -= workcount;
+		next = (t1 > t0) ? (int)((RCU_WORKER_SLICE * workcount) / (t1 - t0)) : d->worker_batch;
+		batch = (batch + next + 1) / 2;
+		if (batch > d->worker_batch)
+			batch = d->worker_batch;
+
+		pthread_mutex_lockx(&d->rcu_mutex);
+		rcu_workdone(d, workcount, epochcount);
+		d->stats.cbtime += (t1 - t0);
+		if (cbmax > d->stats.cbmax)
+			d->stats.cbmax = cbmax;
+		d->stats.batches++;
+		rcu_barrier_done(d);
 	}
 
-	return;
+	pthread_mutex_unlockx(&d->rcu_mutex);
+
+	return NULL;
+}
+
+
+//-----------------------------------------------------------------------------
+// rcu_stopworkers -- stop worker pool after it drains the worker queue
+//
+//   Ready work is run inline from here on.
+//-----------------------------------------------------------------------------
+static void rcu_stopworkers(smr_domain_t *d) {
+	pthread_t	*ids;
+	int			n, j;
+
+	pthread_mutex_lockx(&d->rcu_mutex);
+	n = d->rcu_workers;
+	ids = d->worker_ids;
+	d->rcu_workers = 0;
+	d->worker_ids = NULL;
+	d->worker_stop = 1;
+	pthread_cond_broadcast(&d->worker_cvar);
+	pthread_mutex_unlockx(&d->rcu_mutex);
+
+	for (j = 0; j < n; j++)
+		pthread_join(ids[j], NULL);
+	free(ids);
 }
 
 
 //-----------------------------------------------------------------------------
 // rcu_xxxx --
 //-----------------------------------------------------------------------------
-int rcu_xxxx() {
+int rcu_xxxx(smr_domain_t *d) {
+
+	// queue work from threads' retire lists
+	//
+	smr_drain(d);
+
+	// grace period for smr_get_state w/ none in flight
+	//
+	if (atomic_load(&d->sync_wanted) && d->sync_started == d->sync_done) {
+		__atomic_store_n(&d->sync_wanted, 0, __ATOMIC_RELAXED);
+		d->stats.states++;
+		rcu_sync_start(d);
+	}
+
+	if (d->gp_start == 0 && d->deferred_work > 0)
+		d->gp_start = getutimeofday();
 
 	// poll threads for quiesce points
 	//
-	rcu_scan();
+	rcu_scan(d);
 
 	// check for any work on smr_queue not
 	// in any thread's hazard ptr
 	//
-	smr_scan();
+	smr_scan(d);
 
 	// process ready deferred work
 	//
-	if (ready_queue.tail != NULL) {
-		process_work();
+	if (d->ready_queue.tail != NULL) {
+		process_work(d);
 		return 1;
 	}
 
@@ -182,38 +511,40 @@ int rcu_xxxx() {
 
 //-----------------------------------------------------------------------------
 // rcu_poll	-- deferred work polling routine
-//             invoked by pthread_create from rcu_init
+//             invoked by pthread_create from rcu_startpoll
 //
 //-----------------------------------------------------------------------------
 void *rcu_poll(void *z) {
+	smr_domain_t	*d = (smr_domain_t *)z;
 	utime_t	now, next;
 	struct	timespec	nexttime;
 
 
-	pthread_mutex_lockx(&rcu_mutex);
+	smr_service = 1;
+	pthread_mutex_lockx(&d->rcu_mutex);
 
 	for (;;) {
 
-		if (rcu_xxxx())
+		if (rcu_xxxx(d))
 			;
 
-		else if (deferred_work > 0) {
+		else if (d->deferred_work > 0) {
 			//
 			// no quiesce point, wait a while
 			//
 
 			now = getutimeofday();
-			next = now + rcu_minWait;
+			next = now + rcu_pollwait(d);
 			nexttime.tv_sec = utime_sec(next);
 			nexttime.tv_nsec = utime_nsec(next);
-			pthread_cond_timedwait(&rcu_cvar, &rcu_mutex, &nexttime);
+			pthread_cond_timedwait(&d->rcu_cvar, &d->rcu_mutex, &nexttime);
 
-			stats.qwaits++;
-			stats.qtime += (getutimeofday() - now);
+			d->stats.qwaits++;
+			d->stats.qtime += (getutimeofday() - now);
 
 		} // if  (deferred_work > 0)
 
-		else if (rcu_stop != 0) {
+		else if (d->rcu_stop != 0) {
 			break;
 		}
 
@@ -221,11 +552,18 @@ void *rcu_poll(void *z) {
 		// wait for work
 		//
 		else {
-			now = getutimeofday();
-			pthread_cond_wait(&rcu_cvar, &rcu_mutex);
+			atomic_store(&d->rcu_idle, 1);
+			__sync_synchronize();		// store/load, pairs w/ smr_retire cas
+
+			if (!smr_incoming(d) && !atomic_load(&d->sync_wanted)) {
+				now = getutimeofday();
+				pthread_cond_wait(&d->rcu_cvar, &d->rcu_mutex);
 
-			stats.wwaits++;
-			stats.wtime += (getutimeofday() - now);
+				d->stats.wwaits++;
+				d->stats.wtime += (getutimeofday() - now);
+			}
+
+			atomic_store(&d->rcu_idle, 0);
 		}
 
 
@@ -233,10 +571,10 @@ void *rcu_poll(void *z) {
 
 printf("polling thread shutting down...\n");
 
-	if (ready_queue.tail != NULL || deferred_work != 0)
+	if (d->ready_queue.tail != NULL || d->deferred_work != 0)
 		abort();
 
-	pthread_mutex_unlockx(&rcu_mutex);
+	pthread_mutex_unlockx(&d->rcu_mutex);
 
 printf("polling thread returning...\n");
 
@@ -245,71 +583,372 @@ printf("polling thread returning...\n");
 
 
 //------------------------------------------------------------------------------
-// smr_defer -- 
+// rcu_wakeup -- wake polling thread for handed off work
 //
+//   rcu_idle is read after the retire cas.  The polling thread sets
+//   it and checks for handed off work w/ rcu_mutex held before waiting,
+//   so taking the mutex here can't miss the wait.
 //------------------------------------------------------------------------------
-int smr_defer(rcu_defer_t *work) {
+void rcu_wakeup(smr_domain_t *d) {
+	if (atomic_load(&d->rcu_idle)) {
+		pthread_mutex_lockx(&d->rcu_mutex);
+		d->stats.defersigs++;
+		pthread_mutex_unlockx(&d->rcu_mutex);
+		pthread_cond_signal(&d->rcu_cvar);
+	}
+}
+
+
+//------------------------------------------------------------------------------
+// rcu_defer_locked -- queue work for pass 1 w/ rcu_mutex held
+//
+//   returns previous deferred work count, 0 if the polling thread
+//   needs to be signaled
+//------------------------------------------------------------------------------
+static int rcu_defer_locked(smr_domain_t *d, rcu_defer_t *work) {
 	int			n;
 
-	pthread_mutex_lockx(&rcu_mutex);
-	stats.defers++;
+	d->stats.defers++;
 
-	work->sequence = current - 1;
+	work->sequence = d->current - 1;
 
-	rcu_enqueue(work, pass1);
+	rcu_enqueue(d, work, pass1);
 
-	if ((n = deferred_work++) == 0)
-		stats.defersigs++;
+	if ((n = d->deferred_work++) == 0) {
+		d->stats.defersigs++;
+		if (d->gp_start == 0)
+			d->gp_start = getutimeofday();
+	}
+
+	return n;
+}
 
 
-	pthread_mutex_unlockx(&rcu_mutex);
+//------------------------------------------------------------------------------
+// smr_domain_defer -- 
+//
+//   Threads push work onto a retire list in their smr node w/o taking
+//   rcu_mutex and the polling thread takes every thread's list each
+//   pass.  The node is made by the thread's first defer if it has none.
+//   The mutex is only taken to wake the polling thread if it's waiting
+//   for work, and to queue work from the polling thread, callback
+//   workers, or a thread whose node couldn't be allocated.
+//
+//------------------------------------------------------------------------------
+int smr_domain_defer(smr_domain_t *d, rcu_defer_t *work) {
+	int			n;
+
+	switch (smr_retire(d, work)) {
+		case 0:					// buffered
+			return 0;
+
+		case 1:					// list was empty
+			rcu_wakeup(d);
+			return 0;
+
+		default:				// no smr node, locked
+			break;
+	}
+
+	pthread_mutex_lockx(&d->rcu_mutex);
+	d->stats.lockdefers++;
+	n = rcu_defer_locked(d, work);
+	pthread_mutex_unlockx(&d->rcu_mutex);
 
 	if (n == 0)			 // polling thread waiting for work
-		pthread_cond_signal(&rcu_cvar);
+		pthread_cond_signal(&d->rcu_cvar);
 
 	return 0;
 }
 
+int smr_defer(rcu_defer_t *work) {
+	return smr_domain_defer(&rcu_default, work);
+}
+
+
+//------------------------------------------------------------------------------
+// rcu_sync_start -- start a grace period for smr_synchronize w/ rcu_mutex held
+//
+//   The sentinel is deferred like any other work.  Once every thread
+//   has passed a quiesce point smr_scan records the non-null hazard
+//   pointers and holds the sentinel until each has changed, so it runs
+//   after readers have let go of anything they could have been
+//   holding when the grace period started.
+//------------------------------------------------------------------------------
+static void rcu_sync_start(smr_domain_t *d) {
+	atomic_store_rel(&d->sync_started, d->sync_started + 1);
+	d->sync_snapped = 0;
+	d->stats.syncgps++;
+	if (rcu_defer_locked(d, &d->sync_work) == 0)
+		pthread_cond_signal(&d->rcu_cvar);
+}
+
+
+//------------------------------------------------------------------------------
+// rcu_sync_cb -- grace period sentinel, polling thread
+//------------------------------------------------------------------------------
+static void rcu_sync_cb(void *arg) {
+	smr_domain_t	*d = (smr_domain_t *)arg;
+
+	pthread_mutex_lockx(&d->rcu_mutex);
+	atomic_store_rel(&d->sync_done, d->sync_started);
+	if (__atomic_exchange_n(&d->sync_wanted, 0, __ATOMIC_ACQ_REL))
+		rcu_sync_start(d);
+	pthread_mutex_unlockx(&d->rcu_mutex);
+
+	pthread_cond_broadcast(&d->sync_cvar);
+}
+
+
+//------------------------------------------------------------------------------
+// rcu_sync_refs -- sentinel trace callback, the sentinel references nothing
+//------------------------------------------------------------------------------
+static void rcu_sync_refs(void *arg, refcb_t cb) {
+	(void)arg;
+	(void)cb;
+}
+
+
+//------------------------------------------------------------------------------
+// smr_domain_synchronize -- wait for a grace period
+//
+//   Returns after every thread has passed a quiesce point and every
+//   hazard pointer set at the time of the call has been cleared or
+//   changed, so anything unlinked before the call is no longer
+//   referenced.  Callers arriving while a grace period is in flight
+//   share the next one.  Not from deferred work functions, and not w/
+//   hazard pointers of the caller's own set, which would never change.
+//------------------------------------------------------------------------------
+void smr_domain_synchronize(smr_domain_t *d) {
+	sequence_t	target;
+
+	pthread_mutex_lockx(&d->rcu_mutex);
+	d->stats.syncs++;
+
+	if (d->sync_started == d->sync_done) {
+		rcu_sync_start(d);
+		target = d->sync_started;
+	}
+	else {
+		atomic_store(&d->sync_wanted, 1);
+		target = d->sync_started + 1;
+	}
+
+	while ((int)(d->sync_done - target) < 0)
+		pthread_cond_wait(&d->sync_cvar, &d->rcu_mutex);
+
+	pthread_mutex_unlockx(&d->rcu_mutex);
+}
+
+void smr_synchronize() {
+	smr_domain_synchronize(&rcu_default);
+}
+
+
+//------------------------------------------------------------------------------
+// smr_domain_get_state -- grace period cookie
+//
+//   Returns the smr_synchronize grace period that covers anything
+//   unlinked before the call, the next one to start.  Once
+//   smr_poll_state returns 1 for the cookie it's safe to reuse what
+//   was unlinked, as after smr_synchronize.
+//
+//   No locking.  sync_wanted is set w/ an exchange, a full memory
+//   barrier, so the polling thread starts the grace period at its next
+//   pass or when the one in flight completes, and the caller sees
+//   rcu_idle as of after it's set.  Usually the flag is already set and
+//   it's a load.
+//------------------------------------------------------------------------------
+sequence_t smr_domain_get_state(smr_domain_t *d) {
+	sequence_t	cookie;
+
+	cookie = atomic_load_acq(&d->sync_started) + 1;
+
+	if (!atomic_load(&d->sync_wanted)) {
+		__atomic_exchange_n(&d->sync_wanted, 1, __ATOMIC_SEQ_CST);
+		rcu_wakeup(d);
+	}
+
+	return cookie;
+}
+
+sequence_t smr_get_state() {
+	return smr_domain_get_state(&rcu_default);
+}
+
+
+//------------------------------------------------------------------------------
+// smr_domain_poll_state -- cookie's grace period done 0|1
+//
+//   A single acquire load, no locking.  It pairs w/ the release store
+//   of sync_done after the grace period's sentinel has run so reuse of
+//   the memory is ordered after it.
+//------------------------------------------------------------------------------
+int smr_domain_poll_state(smr_domain_t *d, sequence_t cookie) {
+	return ((int)(atomic_load_acq(&d->sync_done) - cookie) >= 0);
+}
+
+int smr_poll_state(sequence_t cookie) {
+	return smr_domain_poll_state(&rcu_default, cookie);
+}
+
+
+//------------------------------------------------------------------------------
+// smr_domain_barrier -- wait for deferred work to run
+//
+//   Waits for all work deferred before the call, by any thread,
+//   including work still on other threads' retire lists.  Callers in
+//   the same epoch share it.  Not from deferred work functions.
+//------------------------------------------------------------------------------
+void smr_domain_barrier(smr_domain_t *d) {
+	sequence_t	target;
+
+	pthread_mutex_lockx(&d->rcu_mutex);
+	d->stats.barriers++;
+
+	// retired work joins the current epoch
+	smr_drain(d);
+	if (d->gp_start == 0 && d->deferred_work > 0)
+		d->gp_start = getutimeofday();
+
+	target = d->barrier_gen;
+
+	while ((int)(d->barrier_done - target) < 0) {
+		if (d->barrier_gen == target && d->barrier_done + 1 == target) {
+			d->barrier_gen++;			// close epoch, new work to next
+			d->stats.barrierepochs++;
+			rcu_barrier_done(d);
+		}
+		else
+			pthread_cond_wait(&d->sync_cvar, &d->rcu_mutex);
+	}
+
+	pthread_mutex_unlockx(&d->rcu_mutex);
+}
+
+void smr_barrier() {
+	smr_domain_barrier(&rcu_default);
+}
+
 
 //------------------------------------------------------------------------------
 // rcu_check --
 //------------------------------------------------------------------------------
-void rcu_check() {
-	if (deferred_work > 0 && pthread_mutex_trylock(&rcu_mutex) == 0) {
-		rcu_xxxx();
-		pthread_mutex_unlockx(&rcu_mutex);
+void smr_domain_check(smr_domain_t *d) {
+	if (pthread_mutex_trylock(&d->rcu_mutex) == 0) {
+		if (d->deferred_work > 0 || smr_incoming(d))
+			rcu_xxxx(d);
+		pthread_mutex_unlockx(&d->rcu_mutex);
 	}
 }
 
+void rcu_check() {
+	smr_domain_check(&rcu_default);
+}
+
 
 //------------------------------------------------------------------------------
 // rcu_signal --
 //------------------------------------------------------------------------------
+void smr_domain_signal(smr_domain_t *d) {
+	pthread_cond_broadcast(&d->rcu_cvar);
+}
+
 void rcu_signal() {
-	pthread_cond_broadcast(&rcu_cvar);
+	smr_domain_signal(&rcu_default);
 }
 
 
 //------------------------------------------------------------------------------
 // (set|get)MinWait in milliseconds
 //------------------------------------------------------------------------------
+void smr_domain_setMinWait(smr_domain_t *d, int val) {
+	d->rcu_minWait = mtime_utime(val);
+}
+
+int smr_domain_getMinWait(smr_domain_t *d) {
+	return utime_mtime(d->rcu_minWait);
+}
+
 void rcu_setMinWait(int val) {
-	rcu_minWait = mtime_utime(val);
+	smr_domain_setMinWait(&rcu_default, val);
 }
 
 int rcu_getMinWait() {
-	return utime_mtime(rcu_minWait);
+	return smr_domain_getMinWait(&rcu_default);
+}
+
+
+//------------------------------------------------------------------------------
+// setTargets -- adaptive polling
+//
+//   maxBacklog is the deferred work count at which polling goes to the
+//   floor interval, 0 for no backlog control.  latency is the target
+//   grace period latency in milliseconds, 0 turns adaptive polling off
+//   and goes back to the fixed rcu_minWait interval.
+//------------------------------------------------------------------------------
+void smr_domain_setTargets(smr_domain_t *d, int maxBacklog, int latency) {
+	pthread_mutex_lockx(&d->rcu_mutex);
+	d->rcu_maxBacklog = (maxBacklog > 0) ? maxBacklog : 0;
+	d->rcu_targetLatency = (latency > 0) ? mtime_utime(latency) : 0;
+	d->rcu_wait = d->rcu_targetLatency / 4;		// ~4 polls per grace period
+	pthread_mutex_unlockx(&d->rcu_mutex);
+}
+
+void rcu_setTargets(int maxBacklog, int latency) {
+	smr_domain_setTargets(&rcu_default, maxBacklog, latency);
+}
+
+
+//------------------------------------------------------------------------------
+// setWorkers -- callback worker pool
+//
+//   Replaces any current pool w/ n worker threads taking at most batch
+//   callbacks at a time, 0 for the default.  n of 0 goes back to running
+//   callbacks inline on the polling thread, the default.  Not from
+//   deferred work functions or concurrently w/ itself.
+//------------------------------------------------------------------------------
+void smr_domain_setWorkers(smr_domain_t *d, int n, int batch) {
+	pthread_t	*ids;
+	int			j;
+
+	rcu_stopworkers(d);
+
+	if (n <= 0)
+		return;
+
+	if ((ids = (pthread_t *)malloc(n * sizeof(pthread_t))) == NULL)
+		abort();
+
+	pthread_mutex_lockx(&d->rcu_mutex);
+	d->worker_stop = 0;
+	d->worker_batch = (batch > 0) ? batch : RCU_WORKER_BATCH;
+	for (j = 0; j < n; j++) {
+		if (pthread_create(&ids[j], NULL, &rcu_worker, d) != 0)
+			break;
+	}
+	d->worker_ids = ids;
+	d->rcu_workers = j;
+	pthread_mutex_unlockx(&d->rcu_mutex);
+}
+
+void rcu_setWorkers(int n, int batch) {
+	smr_domain_setWorkers(&rcu_default, n, batch);
 }
 
 
 //------------------------------------------------------------------------------
 // copyStats --
 //------------------------------------------------------------------------------
+void smr_domain_copyStats(smr_domain_t *d, rcu_stats_t * target) {
+	pthread_mutex_lockx(&d->rcu_mutex);
+	memcpy(target, &d->stats, sizeof(d->stats));
+	target->deferred_work = d->deferred_work;
+	pthread_mutex_unlockx(&d->rcu_mutex);
+}
+
 void copyStats(rcu_stats_t * target) {
-	pthread_mutex_lockx(&rcu_mutex);
-	memcpy(target, &stats, sizeof(stats));
-	target->deferred_work = deferred_work;
-	pthread_mutex_unlockx(&rcu_mutex);
+	smr_domain_copyStats(&rcu_default, target);
 }
 
 
@@ -29,6 +29,7 @@ warranty.
 extern "C" {
 #endif
 
+#include <stddef.h>
 #include <utime.h>
 
 
@@ -48,6 +49,7 @@ typedef enum {
 	fifo = 1,						// deallocate in fifo order
 	trace = 2,						// trace reachable nodes
 	//ref = 3,						// refcount nodes
+	bulk = 4,						// smr_defer_free page of pointers
 } smr_reftype_t;
 
 typedef unsigned int sequence_t;	// sequence
@@ -64,6 +66,7 @@ typedef struct rcu_defer_tt {
 
 	//--
 
+	sequence_t	barrier;			// smr_barrier epoch
 	smr_reftype_t	type;			//
 	rcu_defer_state_t state;		// 
 	struct rcu_defer_tt *	next;	//
@@ -72,6 +75,8 @@ typedef struct rcu_defer_tt {
 
 typedef int (*refcb_t)(rcu_defer_t *);
 
+typedef struct smr_domain_tt smr_domain_t;	// rcu/smr instance
+
 //=============================================================================
 // public
 //=============================================================================
@@ -84,9 +89,53 @@ extern smr_t * smr_alloc();				// allocate hazard pointer
 extern void smr_dealloc(smr_t *);		// deallocate hazard pointer
 
 extern int smr_defer(rcu_defer_t *);	// defer work 
+extern int smr_flush();					// retire thread's partial free page
+
+extern int smr_defer_free(void *);				// defer free()
+extern int smr_defer_free_sized(void *, size_t);	// defer free() of size bytes
+
+extern void smr_synchronize();			// wait for a grace period
+extern void smr_barrier();				// wait for deferred work to run
+
+extern sequence_t smr_get_state();		// grace period cookie
+extern int smr_poll_state(sequence_t);	// cookie's grace period done 0|1
 
 extern void rcu_setMinWait(int);		// set polling interval (msecs)
 extern int rcu_getMinWait();			// get polling interval (msecs)
+extern void rcu_setTargets(int, int);	// set max backlog and grace period latency (msecs)
+extern void rcu_setWorkers(int, int);	// set callback worker threads and max batch
+
+//-----------------------------------------------------------------------------
+// domains -- independent instances, each reclaiming at its own rate w/
+// its own polling thread.  The functions above use the default domain
+// started by rcu_startup.
+//-----------------------------------------------------------------------------
+
+extern smr_domain_t * smr_domain_create();				// create and start domain
+extern void smr_domain_destroy(smr_domain_t *);			// shutdown and free domain
+extern smr_domain_t * smr_domain_default();				// default domain
+
+extern smr_t * smr_domain_acquire(smr_domain_t *);		// acquire thread hazard pointer
+extern smr_t * smr_domain_alloc(smr_domain_t *);		// allocate hazard pointer
+extern void smr_domain_dealloc(smr_domain_t *, smr_t *);	// deallocate hazard pointer
+extern void smr_domain_release(smr_domain_t *);			// release thread from domain
+
+extern int smr_domain_defer(smr_domain_t *, rcu_defer_t *);	// defer work
+extern int smr_domain_flush(smr_domain_t *);			// retire thread's partial free page
+
+extern int smr_domain_defer_free(smr_domain_t *, void *);	// defer free()
+extern int smr_domain_defer_free_sized(smr_domain_t *, void *, size_t);	// defer free() of size bytes
+
+extern void smr_domain_synchronize(smr_domain_t *);		// wait for a grace period
+extern void smr_domain_barrier(smr_domain_t *);			// wait for deferred work to run
+
+extern sequence_t smr_domain_get_state(smr_domain_t *);	// grace period cookie
+extern int smr_domain_poll_state(smr_domain_t *, sequence_t);	// cookie's grace period done 0|1
+
+extern void smr_domain_setMinWait(smr_domain_t *, int);	// set polling interval (msecs)
+extern int smr_domain_getMinWait(smr_domain_t *);		// get polling interval (msecs)
+extern void smr_domain_setTargets(smr_domain_t *, int, int);	// set max backlog and grace period latency (msecs)
+extern void smr_domain_setWorkers(smr_domain_t *, int, int);	// set callback worker threads and max batch
 
 #ifdef __cplusplus
 }
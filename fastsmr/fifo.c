@@ -67,6 +67,32 @@ rcu_defer_t *fifo_dequeueall(fifo_t *q) {
 }
 
 
+//-----------------------------------------------------------------------------
+// fifo_dequeuen -- dequeue up to n items, oldest first, null terminated
+//
+//-----------------------------------------------------------------------------
+rcu_defer_t *fifo_dequeuen(fifo_t *q, int n, int *count) {
+	rcu_defer_t	*item;
+	rcu_defer_t	*last;
+	int			k;
+
+	if ((item = q->tail) == NULL) {
+		*count = 0;
+		return NULL;
+	}
+
+	for (last = item, k = 1; k < n && last->next != NULL; k++)
+		last = last->next;
+
+	if ((q->tail = last->next) == NULL)
+		q->head = NULL;
+	last->next = NULL;
+
+	*count = k;
+	return item;
+}
+
+
 //-----------------------------------------------------------------------------
 // requeue -- requeue work onto another queue
 //
@@ -0,0 +1,201 @@
+/*
+Copyright 2006 Joseph W. Seigh
+
+Permission to use, copy, modify and distribute this software
+and its documentation for any purpose and without fee is
+hereby granted, provided that the above copyright notice
+appear in all copies, that both the copyright notice and this
+permission notice appear in supporting documentation.  I make
+no representations about the suitability of this software for
+any purpose. It is provided "as is" without express or implied
+warranty.
+
+---
+*/
+
+//------------------------------------------------------------------------------
+// qcount.c -- thread quiescent state counts for RCU polling, Linux
+//
+// version -- 0.0.1 (pre-alpha)
+//
+//
+//------------------------------------------------------------------------------
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/membarrier.h>
+
+#include <qcount.h>
+
+
+//------------------------------------------------------------------------------
+// qcount object
+//------------------------------------------------------------------------------
+struct qcount_tt {
+	int			expedited;			// private expedited membarrier registered
+	uint32_t	count;				// forced quiescent states
+};
+
+//------------------------------------------------------------------------------
+// thread
+//------------------------------------------------------------------------------
+struct qthread_tt {
+	pid_t		tid;				// kernel thread id
+	volatile uint32_t	count;		// explicit quiescent states
+};
+
+
+static inline int membarrier(int cmd, int flags) {
+	return syscall(__NR_membarrier, cmd, flags);
+}
+
+
+//------------------------------------------------------------------------------
+// qcount_init --
+//------------------------------------------------------------------------------
+int qcount_init(qcount_t *q) {
+	qcount_t	x;
+	int			cmds;
+
+	if ((x = (qcount_t)malloc(sizeof(struct qcount_tt))) == NULL)
+		return -1;
+
+	x->count = 0;
+	x->expedited = 0;
+
+	cmds = membarrier(MEMBARRIER_CMD_QUERY, 0);
+	if (cmds > 0 && (cmds & MEMBARRIER_CMD_PRIVATE_EXPEDITED) != 0
+		&& membarrier(MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0) == 0)
+		x->expedited = 1;
+
+	*q = x;
+	return 0;
+}
+
+
+//------------------------------------------------------------------------------
+// qcount_destroy --
+//------------------------------------------------------------------------------
+void qcount_destroy(qcount_t *q) {
+	free(*q);
+	*q = NULL;
+}
+
+
+//------------------------------------------------------------------------------
+// qcount_self -- register calling thread
+//
+//   returns 1 if quiescent states can be polled for, else 0
+//------------------------------------------------------------------------------
+int qcount_self(qcount_t q, qhandle_t *h) {
+	qhandle_t	x;
+
+	if ((x = (qhandle_t)malloc(sizeof(struct qthread_tt))) == NULL)
+		return 0;
+
+	x->tid = (pid_t)syscall(SYS_gettid);
+	x->count = 0;
+
+	*h = x;
+	return 1;
+}
+
+
+//------------------------------------------------------------------------------
+// qcount_release -- unregister thread
+//------------------------------------------------------------------------------
+void qcount_release(qcount_t q, qhandle_t h) {
+	free(h);
+}
+
+
+//------------------------------------------------------------------------------
+// qcount_set -- force quiescent state in all running threads
+//------------------------------------------------------------------------------
+void qcount_set(qcount_t q) {
+	if (q->expedited) {
+		if (membarrier(MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0) != 0)
+			abort();
+		q->count++;
+	}
+}
+
+
+//------------------------------------------------------------------------------
+// qcount_forced -- qcount_set forces quiescent states w/ membarrier 0|1
+//
+//   Each qcount_set is an IPI to every cpu running a thread of the
+//   process, callers should limit how often they call it.
+//------------------------------------------------------------------------------
+int qcount_forced(qcount_t q) {
+	return q->expedited;
+}
+
+
+//------------------------------------------------------------------------------
+// qcount_quiesce -- explicit quiescent state, calling thread only
+//------------------------------------------------------------------------------
+void qcount_quiesce(qhandle_t h) {
+	__sync_synchronize();
+	h->count++;
+}
+
+
+//------------------------------------------------------------------------------
+// qcount_ctxsw -- thread's context switch count and run state from /proc
+//
+//   returns -1 if thread is gone
+//------------------------------------------------------------------------------
+static int qcount_ctxsw(pid_t tid, uint32_t *count, int *runstate) {
+	char		path[64];
+	char		line[128];
+	FILE		*f;
+	unsigned long	n;
+	char		state;
+
+	snprintf(path, sizeof(path), "/proc/self/task/%d/status", (int)tid);
+	if ((f = fopen(path, "r")) == NULL)
+		return -1;
+
+	*count = 0;
+	*runstate = 0;
+	while (fgets(line, sizeof(line), f) != NULL) {
+		if (sscanf(line, "State: %c", &state) == 1)
+			*runstate = (state == 'R');
+		else if (sscanf(line, "voluntary_ctxt_switches: %lu", &n) == 1)
+			*count += (uint32_t)n;
+		else if (sscanf(line, "nonvoluntary_ctxt_switches: %lu", &n) == 1)
+			*count += (uint32_t)n;
+	}
+
+	fclose(f);
+	return 0;
+}
+
+
+//------------------------------------------------------------------------------
+// qcount_get -- thread's quiescent state count
+//
+//   runstate is set to 0 if the thread isn't running
+//------------------------------------------------------------------------------
+uint32_t qcount_get(qcount_t q, qhandle_t h, int *runstate) {
+	uint32_t	ctxsw;
+
+	if (q->expedited) {
+		*runstate = 1;
+		return q->count;
+	}
+
+	if (qcount_ctxsw(h->tid, &ctxsw, runstate) != 0) {
+		*runstate = 0;					// exited
+		return h->count;
+	}
+
+	return ctxsw + h->count;
+}
+
+
+/*-*/
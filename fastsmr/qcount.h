@@ -0,0 +1,64 @@
+/*
+Copyright 2006 Joseph W. Seigh
+
+Permission to use, copy, modify and distribute this software
+and its documentation for any purpose and without fee is
+hereby granted, provided that the above copyright notice
+appear in all copies, that both the copyright notice and this
+permission notice appear in supporting documentation.  I make
+no representations about the suitability of this software for
+any purpose. It is provided "as is" without express or implied
+warranty.
+
+---
+*/
+
+//------------------------------------------------------------------------------
+// qcount.h -- thread quiescent state counts for RCU polling, Linux
+//
+// version -- 0.0.1 (pre-alpha)
+//
+// qcount_set forces a quiescent state, a full memory barrier, in every
+// running thread of the process w/ membarrier(MEMBARRIER_CMD_PRIVATE_EXPEDITED)
+// and bumps the qcount object's count.  Every registered thread has then
+// quiesced w/ respect to everything before the qcount_set, so qcount_get
+// returns the object's count.  Readers need no store/load membar between
+// setting a hazard pointer and reloading the pointer it guards.
+//
+// If expedited membarrier isn't available (pre 4.14 kernels) qcount_get
+// falls back to the thread's context switch count from /proc plus its
+// explicit quiescent states (qcount_quiesce).  A context switch implies a
+// memory barrier on the thread's processor.  A thread that isn't running
+// is reported as not running.
+//
+//------------------------------------------------------------------------------
+
+#ifndef QCOUNT_H
+#define QCOUNT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+typedef struct qcount_tt * qcount_t;		// qcount object
+typedef struct qthread_tt * qhandle_t;		// qcount query handle (thread)
+
+extern int qcount_init(qcount_t *);			// returns 0 if ok
+extern void qcount_destroy(qcount_t *);
+
+extern int qcount_self(qcount_t, qhandle_t *);		// register calling thread
+extern void qcount_release(qcount_t, qhandle_t);	// unregister thread
+
+extern void qcount_set(qcount_t);			// force quiescent states
+extern int qcount_forced(qcount_t);			// qcount_set forces them 0|1
+extern uint32_t qcount_get(qcount_t, qhandle_t, int *runstate);
+
+extern void qcount_quiesce(qhandle_t);		// explicit quiescent state
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* QCOUNT_H */
@@ -70,18 +70,11 @@ typedef struct rcu_node_tt {
 } rcu_node_t;
 
 
-//------------------------------------------------------------------------------
-//------------------------------------------------------------------------------
-qcount_t	qcobj;					// qcount object
-
-rcu_node_t	*current_node = NULL;
-
-
 //-----------------------------------------------------------------------------
 // rcu_requeue -- transfer work to smr or ready queue
 //
 //-----------------------------------------------------------------------------
-void rcu_requeue(fifo_t *q) {
+void rcu_requeue(smr_domain_t *d, fifo_t *q) {
 	rcu_defer_t	*workqueue;
 	rcu_defer_t	*work;
 
@@ -91,10 +84,10 @@ void rcu_requeue(fifo_t *q) {
 		workqueue = work->next;
 
 		if (work->state == pass1)
-			smr_enqueue(work);
+			smr_enqueue(d, work);
 
 		else
-			fifo_enqueue(&ready_queue, work);
+			fifo_enqueue(&d->ready_queue, work);
 
 	}
 
@@ -104,19 +97,24 @@ void rcu_requeue(fifo_t *q) {
 //------------------------------------------------------------------------------
 // rcu_enqueue --
 //------------------------------------------------------------------------------
-void rcu_enqueue(rcu_defer_t *work, rcu_defer_state_t state) {
+void rcu_enqueue(smr_domain_t *d, rcu_defer_t *work, rcu_defer_state_t state) {
 	rcu_node_t	*node;
 	
+	if (state == pass1) {				// new work, smr_barrier epoch
+		work->barrier = d->barrier_gen;
+		d->barrier_count[work->barrier & 1]++;
+	}
+
 	work->state = state;
-	node = current_node;
+	node = d->current_node;
 	if (node != NULL)
 		fifo_enqueue(&(node->queue0), work);
 
 	else if (work->state == pass1)
-		smr_enqueue(work);
+		smr_enqueue(d, work);
 
 	else
-		fifo_enqueue(&ready_queue, work);
+		fifo_enqueue(&d->ready_queue, work);
 
 
 	return;
@@ -127,7 +125,7 @@ void rcu_enqueue(rcu_defer_t *work, rcu_defer_state_t state) {
 // rcu_add_node --
 //
 //------------------------------------------------------------------------------
-void rcu_add_node(qhandle_t qhandle) {
+void rcu_add_node(smr_domain_t *d, qhandle_t qhandle) {
 	rcu_node_t *node;
 	int		runstate;
 
@@ -140,7 +138,7 @@ void rcu_add_node(qhandle_t qhandle) {
 	node->qhandle = qhandle;
 
 	// set initial quiesce count and runstate
-	node->last_qcount = qcount_get(qcobj, node->qhandle, &runstate);
+	node->last_qcount = qcount_get(d->qcobj, node->qhandle, &runstate);
 
 	fifo_init(&(node->queue0));
 	fifo_init(&(node->queue1));
@@ -152,17 +150,17 @@ void rcu_add_node(qhandle_t qhandle) {
 	// link prior to current (can be anywhere)
 	//
 
-	if (current_node == NULL) {
+	if (d->current_node == NULL) {
 		node->next = node;
 		node->prev = node;
 
-		current_node = node;
+		d->current_node = node;
 	}
 
 	else {
-		node->next = current_node;
-		node->prev = current_node->prev;
-		current_node->prev = node;
+		node->next = d->current_node;
+		node->prev = d->current_node->prev;
+		d->current_node->prev = node;
 		node->prev->next = node;
 	}
 
@@ -174,21 +172,21 @@ void rcu_add_node(qhandle_t qhandle) {
 //------------------------------------------------------------------------------
 // rcu_delete_node --
 //------------------------------------------------------------------------------
-void rcu_delete_node(qhandle_t qhandle) {
+void rcu_delete_node(smr_domain_t *d, qhandle_t qhandle) {
 	rcu_node_t	*node;
 	
-	if (current_node == NULL)
+	if (d->current_node == NULL)
 		return;
 	//
 	// lookup node by qhandle 
 	//
-	node = current_node;
+	node = d->current_node;
 	do {
 		if (node->qhandle == qhandle)	// pthread_equal?
 			break;
 		node = node->next;
 	}
-	while (node != current_node);
+	while (node != d->current_node);
 
 	if (node->qhandle != qhandle) {
 		return;
@@ -196,21 +194,21 @@ void rcu_delete_node(qhandle_t qhandle) {
 		
 
 	if (node->next == node) {		// last node
-		current_node = NULL;
+		d->current_node = NULL;
 
 		// transfer work to smr_queue or ready_queue
-		rcu_requeue(&(node->queue0));
-		rcu_requeue(&(node->queue1));
+		rcu_requeue(d, &(node->queue0));
+		rcu_requeue(d, &(node->queue1));
 
-		pthread_cond_broadcast(&rcu_cvar);
+		pthread_cond_broadcast(&d->rcu_cvar);
 	}
 
 	else {
 		// bump current node forward if necessary
 		// note: bumping current_node backwards would revisit
 		// previous node without checkpointing intermediate nodes.
-		if (current_node == node)
-			current_node = node->next;
+		if (d->current_node == node)
+			d->current_node = node->next;
 
 		//
 		// delink from node list
@@ -234,24 +232,56 @@ void rcu_delete_node(qhandle_t qhandle) {
 }
 
 
+//-----------------------------------------------------------------------------
+// rcu_pending -- any work waiting for quiesce points
+//-----------------------------------------------------------------------------
+static int rcu_pending(smr_domain_t *d) {
+	rcu_node_t	*node;
+
+	if ((node = d->current_node) == NULL)
+		return 0;
+
+	do {
+		if (node->queue0.tail != NULL || node->queue1.tail != NULL)
+			return 1;
+		node = node->next;
+	}
+	while (node != d->current_node);
+
+	return 0;
+}
+
+
 //-----------------------------------------------------------------------------
 // rcu_scan -- check for quiesce points and process ready work
 //
+//   qcount_set is skipped if nothing is waiting for quiesce points or
+//   it was called less than rcu_waitFloor ago.  Threads then show no
+//   new quiesce points until the next one.
 //-----------------------------------------------------------------------------
-void rcu_scan() {
+void rcu_scan(smr_domain_t *d) {
 	utime_t	now;
 	rcu_node_t	*node;
 	int		qcount;				// working copy of qcount
 	int		runstate;
 
+	if (!rcu_pending(d))
+		return;
+
 	//
 	// poll threads/processors for quiesce points
 	//
 
-	qcount_set(qcobj);
+	now = getutimeofday();
+	if (now - d->qcount_time >= d->rcu_waitFloor) {
+		qcount_set(d->qcobj);
+		d->qcount_time = now;
+		d->stats.qsets++;
+	}
+	else
+		d->stats.qskips++;
 
-	if((node = current_node) == NULL)
-		return;
+	node = d->current_node;
 
 	do {
 
@@ -261,24 +291,24 @@ void rcu_scan() {
 		// check for quiesce point
 		//----------------------------------------------------------------------
 
-		qcount = qcount_get(qcobj, node->qhandle, &runstate);
+		qcount = qcount_get(d->qcobj, node->qhandle, &runstate);
 
 		// thread/processor not running
 		if (!runstate) {
 			node->state = state_norun;
-			stats.norun++;
+			d->stats.norun++;
 		}
 
 		// thread/processor quiesced
 		else if (qcount != node->last_qcount) {
 			node->state  = state_explicit;
-			stats.qexplicit++;
+			d->stats.qexplicit++;
 		}
 
 		// no quiesce point
 		else {
 			node->state  = state_idle;
-			stats.idle++;
+			d->stats.idle++;
 
 			break;						// no quiesce point, wait a while
 		}
@@ -289,20 +319,20 @@ void rcu_scan() {
 
 		node->last_qcount = qcount;		// update last seen eventcount
 		node->last_time = now;			// time quiesce point was seen
-		stats.qpoints++;				// count of quiesce points overall
+		d->stats.qpoints++;				// count of quiesce points overall
 
 		//
 		// shift work on deferred work queues
 		//
 		node = node->next;
 
-		rcu_requeue(&(node->queue1));
+		rcu_requeue(d, &(node->queue1));
 		fifo_requeue(&(node->queue1), &(node->queue0));
 
 	}
-	while (node != current_node);
+	while (node != d->current_node);
 
-	current_node = node;
+	d->current_node = node;
 
 	return;
 
@@ -312,21 +342,21 @@ void rcu_scan() {
 //------------------------------------------------------------------------------
 //
 //------------------------------------------------------------------------------
-void rcu_shutdown2() {
-	pthread_mutex_lockx(&rcu_mutex);
-	while (current_node != NULL) {
-		rcu_delete_node(current_node->qhandle);
+void rcu_shutdown2(smr_domain_t *d) {
+	pthread_mutex_lockx(&d->rcu_mutex);
+	while (d->current_node != NULL) {
+		rcu_delete_node(d, d->current_node->qhandle);
 	}
-	pthread_mutex_unlockx(&rcu_mutex);
+	pthread_mutex_unlockx(&d->rcu_mutex);
 }
 
 
 //------------------------------------------------------------------------------
 // rcu_incoming -- new work
 //------------------------------------------------------------------------------
-int rcu_incoming() {
-	if (current_node)
-		return (current_node->queue0.head != NULL);
+int rcu_incoming(smr_domain_t *d) {
+	if (d->current_node)
+		return (d->current_node->queue0.head != NULL);
 	else
 		return 0;
 }
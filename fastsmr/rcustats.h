@@ -44,10 +44,13 @@ typedef struct {
 	utime_t wtime;		// accumlated wait for work time
 	//
 	int		qwakeups;	// quiesce point wait wakeups 
+	int		qsets;		// qcount_set calls, membarriers if forced
+	int		qskips;		// qcount_set skipped, too soon after last
 	//
 	int		defers;		// number of defers
 	int		undefers;	// number of undefers (continues)
 	int		defersigs;	// defer instant quiesce wakeups
+	int		lockdefers;	// defers queued under rcu_mutex, no smr node
 	int		idle;		// number of idle (non quiesced)
 
 	//
@@ -55,6 +58,32 @@ typedef struct {
 	int		smrfull;	// smr queue fully processed
 	int		smrpartial;	// smr queue partial processed
 
+	// adaptive polling (rcu_setTargets)
+	utime_t	wait;		// current poll interval
+	utime_t	gplast;		// last grace period latency
+	utime_t	gpmax;		// max grace period latency
+	int		shortens;	// interval shortened, grace period over target
+	int		lengthens;	// interval lengthened, grace period under half target
+	int		backlogged;	// polls w/ deferred work at or over max backlog
+
+	// smr_synchronize, smr_barrier
+	int		syncs;		// smr_synchronize calls
+	int		syncgps;	// grace periods started for them
+	int		barriers;	// smr_barrier calls
+	int		barrierepochs;	// barrier epochs closed for them
+	int		states;		// grace periods started for smr_get_state
+
+	// callbacks (rcu_setWorkers)
+	utime_t	cbtime;		// accumulated callback time
+	utime_t	cbmax;		// longest callback, worker pool only
+	int		handoffs;	// ready work handed to worker pool
+	int		batches;	// worker batches run
+
+	// smr_defer_free
+	int		frees;		// pointers deferred
+	int		freepages;	// pages of pointers deferred
+	long long	freebytes;	// bytes deferred w/ smr_defer_free_sized
+
 	// debugging info
 	int		deferred_work;	// copy of current deferred work count;
 } rcu_stats_t;
@@ -64,12 +93,17 @@ typedef struct {
 // public
 //=============================================================================
 
+struct smr_domain_tt;
+
 extern void copyStats(rcu_stats_t *);
+extern void smr_domain_copyStats(struct smr_domain_tt *, rcu_stats_t *);
 
 
 // experimental functions
 extern void rcu_check();				// check for work
 extern void rcu_signal();				// check for work
+extern void smr_domain_check(struct smr_domain_tt *);
+extern void smr_domain_signal(struct smr_domain_tt *);
 
 #ifdef __cplusplus
 }
@@ -27,6 +27,7 @@ warranty.
 #include <string.h>
 #include <errno.h>
 #include <time.h>
+#include <stdint.h>
 
 #include <userrcu.h>
 #include <fastsmr.h>
@@ -39,11 +40,19 @@ warranty.
 
 //-----------------------------------------------------------------------------
 // SMR node (thread)
+//
+//   Hazard pointers are kept in cache line sized blocks.  The first block
+//   is in the node, more are allocated as the thread asks for them.
+//   Blocks don't move once allocated so hazard pointers handed out stay
+//   valid; smr_scan sees a new block once ndx covers it.
 //-----------------------------------------------------------------------------
+#define SMR_BLOCK		(128 / sizeof(smr_t))	// hazard pointers per block
+#define SMR_MAXBLOCKS	16						// max blocks per thread
+
 typedef struct smr_node_tt {
 	union {
 		struct {
-			smr_t	hptr[2];		// hazard pointers
+			smr_t	hptr[SMR_BLOCK];	// hazard pointers, first block
 		};
 
 		char	cache[128];			// nominal cache size
@@ -60,25 +69,84 @@ typedef struct smr_node_tt {
 	unsigned int	ndx;			// hptr index
 	unsigned int	hcount;			// number of hazard pointers
 
+	smr_t			*blocks[SMR_MAXBLOCKS];	// hazard pointer blocks
+
+	smr_domain_t	*domain;		// owning domain
+
+	// retire list, newest first.  Pushed by the owning thread w/ a cas
+	// on its own node and taken whole by the polling thread each pass.
+	rcu_defer_t		*rhead;			// newest retired work
+
+	struct smr_page_tt	*fpage;		// smr_defer_free page, exchanged by owner and poller
+
 	// debugging info
 	pthread_t		tid;			// pthread id for thread
 
 } smr_node_t;
 
 
+//-----------------------------------------------------------------------------
+// smr_defer_free page -- bare pointers deferred as one piece of work.  The
+//   page is held in the smr phase until none of its pointers is in a
+//   hazard pointer, then freed w/ all its pointers after pass 2.
+//-----------------------------------------------------------------------------
+#define SMR_PAGE_SIZE	4096				// page allocation
+#define SMR_PAGE_BYTES	(1024 * 1024)		// sized frees held before hand off
+
+typedef struct smr_page_tt {
+	rcu_defer_t		defer;			// page's deferred work
+	unsigned int	count;			// pointers in page
+	size_t			bytes;			// bytes from smr_defer_free_sized
+	void			*ptr[];
+} smr_page_t;
+
+#define SMR_PAGE_PTRS	((SMR_PAGE_SIZE - sizeof(smr_page_t)) / sizeof(void *))
+
+
 //------------------------------------------------------------------------------
 //
 //------------------------------------------------------------------------------
 
-pthread_key_t	smr_key;
-smr_node_t		*smr_node_queue = NULL;	// SMR node list
-fifo_t			smr_queue = FIFO_INITIALIZER;	// SMR work queue;
-sequence_t		current = 0;			// current sequence number
-int				smr_count = 0;			// count of deferred work
+static __thread smr_domain_t	*smr_tracing;	// domain being scanned, for smr_tracecb
+__thread int	smr_service;		// polling thread or callback worker, no smr node
 
-smr_t			*hptr = NULL;			// copied hazard pointer list
-unsigned int	hsize = 0;				// size of list
-unsigned int	hcount = 0;				// count of ptr's in list
+static smr_node_t * smr_node_register(smr_domain_t *);
+
+
+//------------------------------------------------------------------------------
+// smr_slot -- hazard pointer j of node
+//------------------------------------------------------------------------------
+static inline smr_t *smr_slot(smr_node_t *node, unsigned int j) {
+	return &(node->blocks[j / SMR_BLOCK][j % SMR_BLOCK]);
+}
+
+
+//------------------------------------------------------------------------------
+// smr_grow -- add a block of hazard pointers to thread's node
+//
+//   The block is linked in w/ rcu_mutex held so smr_scan, which also
+//   holds it, never sees a partly initialized block.
+//
+//   returns 0 if ok
+//------------------------------------------------------------------------------
+static int smr_grow(smr_node_t *node) {
+	smr_t		*block;
+	unsigned int	n = node->hcount / SMR_BLOCK;
+
+	if (n >= SMR_MAXBLOCKS)
+		return -1;
+
+	if (posix_memalign((void **)&block, 128, SMR_BLOCK * sizeof(smr_t)) != 0)
+		return -1;
+	memset(block, 0, SMR_BLOCK * sizeof(smr_t));
+
+	pthread_mutex_lockx(&node->domain->rcu_mutex);
+	node->blocks[n] = block;
+	node->hcount += SMR_BLOCK;
+	pthread_mutex_unlockx(&node->domain->rcu_mutex);
+
+	return 0;
+}
 
 
 //------------------------------------------------------------------------------
@@ -86,7 +154,7 @@ unsigned int	hcount = 0;				// count of ptr's in list
 //------------------------------------------------------------------------------
 int smr_tracecb(rcu_defer_t *defer) {
 	if (defer->state != live) {
-		defer->sequence = current;		// reachable
+		defer->sequence = smr_tracing->current;		// reachable
 		return 1;
 	}
 
@@ -99,15 +167,15 @@ int smr_tracecb(rcu_defer_t *defer) {
 // smr_enqueue --
 //
 //------------------------------------------------------------------------------
-void smr_enqueue(rcu_defer_t *work) {
-	if (smr_node_queue != NULL) {
+void smr_enqueue(smr_domain_t *d, rcu_defer_t *work) {
+	if (d->smr_node_queue != NULL) {
 		work->state = smr;
-		fifo_enqueue(&smr_queue, work);
-		smr_count++;
+		fifo_enqueue(&d->smr_queue, work);
+		d->smr_count++;
 	}
 
 	else {
-		rcu_enqueue(work, pass2);
+		rcu_enqueue(d, work, pass2);
 	}
 
 	return;
@@ -115,69 +183,498 @@ void smr_enqueue(rcu_defer_t *work) {
 
 
 //------------------------------------------------------------------------------
-// smr_register -- register thread and initialize local data
+// smr_push -- push list of work, newest first, onto smr_retired
 //
-//	note: quiesce point if node created
+//   The whole list goes on w/ one cas.  The cas is a full memory
+//   barrier so the polling thread sees the links and the caller sees
+//   rcu_idle as of after the push.
+//------------------------------------------------------------------------------
+static void smr_push(smr_domain_t *d, rcu_defer_t *head, rcu_defer_t *tail) {
+	rcu_defer_t	*top;
+
+	do {
+		top = d->smr_retired;
+		tail->next = top;
+	}
+	while (!__sync_bool_compare_and_swap(&d->smr_retired, top, head));
+}
+
+
+//------------------------------------------------------------------------------
+// smr_retire -- push work onto thread's retire list w/o locking
+//
+//   The cas is only contended by the polling thread taking the list.
+//   It's a full memory barrier so the caller sees rcu_idle as of after
+//   the push.
+//
+//   A thread's first defer registers it.  The polling thread and callback
+//   workers aren't registered, smr_shutdown would wait on them.
 //
+//   returns -1 if thread has no smr node, 1 if the list was empty and an
+//   idle polling thread needs to be woken, else 0
 //------------------------------------------------------------------------------
-smr_t * smr_acquire() {
+static int smr_node_retire(smr_node_t *node, rcu_defer_t *work) {
+	rcu_defer_t	*top;
+
+	do {
+		top = atomic_load(&node->rhead);
+		work->next = top;
+	}
+	while (!__sync_bool_compare_and_swap(&node->rhead, top, work));
+
+	return (top == NULL);
+}
+
+int smr_retire(smr_domain_t *d, rcu_defer_t *work) {
 	smr_node_t	*node;
-	smr_t		*hptr;
 
+	if ((node = (smr_node_t *)pthread_getspecific(d->smr_key)) == NULL
+		&& (smr_service || (node = smr_node_register(d)) == NULL))
+		return -1;
+
+	return smr_node_retire(node, work);
+}
+
+
+//------------------------------------------------------------------------------
+// smr_page_free -- free page's pointers and page, defer function
+//------------------------------------------------------------------------------
+static void smr_page_free(void *arg) {
+	smr_page_t	*page = (smr_page_t *)arg;
+	unsigned int	j;
+
+	for (j = 0; j < page->count; j++)
+		free(page->ptr[j]);
+	free(page);
+}
+
+
+//------------------------------------------------------------------------------
+// smr_page_alloc --
+//------------------------------------------------------------------------------
+static smr_page_t *smr_page_alloc() {
+	smr_page_t	*page;
+
+	if ((page = (smr_page_t *)malloc(SMR_PAGE_SIZE)) == NULL)
+		return NULL;
+
+	memset(&page->defer, 0, sizeof(rcu_defer_t));
+	page->defer.func = &smr_page_free;
+	page->defer.arg = page;
+	page->defer.type = bulk;
+	page->count = 0;
+	page->bytes = 0;
+
+	return page;
+}
 
-	if ((node = (smr_node_t *)pthread_getspecific(smr_key)) == NULL) {
 
-		// initialize TSD (per thread)
-		if ((node = (smr_node_t *)malloc(sizeof(smr_node_t))) == NULL)
-			return NULL;
+//------------------------------------------------------------------------------
+// smr_page_retire -- move thread's page to its retire list
+//
+//   Only caller is smr_domain_flush, from smr_flush and rcu_fini.  Thread
+//   exit (smr_release) and smr_drain use smr_node_drain, which takes the
+//   page itself.
+//
+//   returns 1 if the list was empty, else 0
+//------------------------------------------------------------------------------
+static int smr_page_retire(smr_node_t *node) {
+	smr_page_t	*page;
 
-		memset(node, 0, sizeof(smr_node_t));
-		node->ndx = 0;
-		node->hcount = 2;
-		node->hptr[0] = NULL;
-		node->hptr[1] = NULL;
+	if ((page = __atomic_exchange_n(&node->fpage, NULL, __ATOMIC_ACQ_REL)) == NULL)
+		return 0;
 
-		// debugging info
-		node->tid = pthread_self();
+	return smr_node_retire(node, &page->defer);		// not smr_retire, caller has the node
+}
 
-		pthread_mutex_lockx(&rcu_mutex);
 
-		// add RCU node if RCU thread polling in effect
-		if (qcount_self(&(node->qhandle))) {
-			qcount_set(qcobj);
-			rcu_add_node(node->qhandle);
+//------------------------------------------------------------------------------
+// smr_defer_free_sized -- defer free() w/o an rcu_defer_t in the object
+//
+//   Pointers collect in a thread local page that goes on the thread's
+//   retire list as one piece of work when it's full or holds
+//   SMR_PAGE_BYTES of sized frees.  The thread takes the page w/ an
+//   exchange for each pointer so the polling thread can take a partial
+//   page at any time.  The first free registers the thread.  The
+//   polling thread, callback workers and threads whose node couldn't be
+//   allocated share a page under rcu_mutex that the polling thread
+//   picks up, or that's handed off as soon as it's full.
+//
+//   returns 0 if ok, -1 if no memory for a page
+//------------------------------------------------------------------------------
+int smr_domain_defer_free_sized(smr_domain_t *d, void *ptr, size_t size) {
+	smr_node_t	*node;
+	smr_page_t	*page;
+	int			n;
+
+	if (ptr == NULL)
+		return 0;
+
+	if ((node = (smr_node_t *)pthread_getspecific(d->smr_key)) == NULL
+		&& (smr_service || (node = smr_node_register(d)) == NULL)) {
+		pthread_mutex_lockx(&d->rcu_mutex);
+		if ((page = d->free_page) == NULL) {
+			if ((page = smr_page_alloc()) == NULL) {
+				pthread_mutex_unlockx(&d->rcu_mutex);
+				return -1;
+			}
+			d->free_page = page;
+		}
+
+		n = page->count++;
+		page->ptr[n] = ptr;
+		page->bytes += size;
+		if (page->count >= SMR_PAGE_PTRS || page->bytes >= SMR_PAGE_BYTES) {
+			d->free_page = NULL;		// next free starts a new page
+			smr_push(d, &page->defer, &page->defer);
 		}
+		pthread_mutex_unlockx(&d->rcu_mutex);
 
-		if (pthread_setspecific(smr_key, (void *)node) != 0)
-			abort();
+		if (n == 0)
+			rcu_wakeup(d);		// picked up by smr_drain
+		return 0;
+	}
 
-		// push onto smr node queue
-		//
+	if ((page = __atomic_exchange_n(&node->fpage, NULL, __ATOMIC_ACQ_REL)) == NULL) {
+		if ((page = smr_page_alloc()) == NULL)
+			return -1;
+	}
 
-		node->next = smr_node_queue;
-		node->prev = NULL;
-		if (smr_node_queue != NULL)
-			smr_node_queue->prev = node;
-		smr_node_queue = node;
+	n = page->count++;
+	page->ptr[n] = ptr;
+	page->bytes += size;
 
-		pthread_mutex_unlockx(&rcu_mutex);
+	if (page->count >= SMR_PAGE_PTRS || page->bytes >= SMR_PAGE_BYTES) {
+		if (smr_node_retire(node, &page->defer))
+			rcu_wakeup(d);
+	}
 
+	// page can be taken and freed once it's back, don't touch it after
+	else {
+		__atomic_store_n(&node->fpage, page, __ATOMIC_RELEASE);
+		if (n == 0) {
+			__sync_synchronize();		// store/load, pairs w/ rcu_poll idle check
+			rcu_wakeup(d);
+		}
 	}
 
-	// return next available pair hazard pointer in array
+	return 0;
+}
+
+int smr_domain_defer_free(smr_domain_t *d, void *ptr) {
+	return smr_domain_defer_free_sized(d, ptr, 0);
+}
+
+int smr_defer_free_sized(void *ptr, size_t size) {
+	return smr_domain_defer_free_sized(smr_domain_default(), ptr, size);
+}
+
+int smr_defer_free(void *ptr) {
+	return smr_domain_defer_free_sized(smr_domain_default(), ptr, 0);
+}
+
+
+//------------------------------------------------------------------------------
+// smr_flush -- retire thread's partial free page and wake polling thread
+//
+//   Not needed for reclamation, the polling thread takes retire lists
+//   and partial pages each pass.
+//
+//   returns 1 if the thread had anything buffered
+//------------------------------------------------------------------------------
+int smr_domain_flush(smr_domain_t *d) {
+	smr_node_t	*node;
+
+	if ((node = (smr_node_t *)pthread_getspecific(d->smr_key)) == NULL)
+		return 0;
+
+	smr_page_retire(node);
+	if (atomic_load(&node->rhead) == NULL)
+		return 0;
+
+	rcu_wakeup(d);
+	return 1;
+}
+
+int smr_flush() {
+	return smr_domain_flush(smr_domain_default());
+}
+
 
-	if (node->ndx < node->hcount) {
-		hptr = &(node->hptr[node->ndx]);
-		node->ndx += 2;
+//------------------------------------------------------------------------------
+// smr_queue -- queue list of work, newest first, for pass 1
+//
+//   Called w/ rcu_mutex held.  Reversing the list puts the work back in
+//   defer order.
+//
+//   returns count of work queued
+//------------------------------------------------------------------------------
+static int smr_queue(smr_domain_t *d, rcu_defer_t *workqueue) {
+	rcu_defer_t	*work;
+	rcu_defer_t	*prev = NULL;
+	smr_page_t	*page;
+	int			n = 0;
+
+	while ((work = workqueue) != NULL) {
+		workqueue = work->next;
+		work->next = prev;
+		prev = work;
 	}
 
-	else
+	while ((work = prev) != NULL) {
+		prev = work->next;
+		if (work->type == bulk) {
+			page = (smr_page_t *)work->arg;
+			d->stats.frees += page->count;
+			d->stats.freepages++;
+			d->stats.freebytes += page->bytes;
+		}
+		work->sequence = d->current - 1;
+		rcu_enqueue(d, work, pass1);
+		n++;
+	}
+
+	d->stats.defers += n;
+	d->deferred_work += n;
+
+	return n;
+}
+
+
+//------------------------------------------------------------------------------
+// smr_node_drain -- take thread's retire list and partial page
+//
+//   Called w/ rcu_mutex held.  The page goes on as newest.
+//
+//   returns count of work queued
+//------------------------------------------------------------------------------
+static int smr_node_drain(smr_domain_t *d, smr_node_t *node) {
+	rcu_defer_t	*workqueue;
+	smr_page_t	*page;
+
+	workqueue = __atomic_exchange_n(&node->rhead, NULL, __ATOMIC_ACQUIRE);
+	if ((page = __atomic_exchange_n(&node->fpage, NULL, __ATOMIC_ACQUIRE)) != NULL) {
+		page->defer.next = workqueue;
+		workqueue = &page->defer;
+	}
+
+	return smr_queue(d, workqueue);
+}
+
+
+//------------------------------------------------------------------------------
+// smr_drain -- queue every thread's retired work and handed off pages
+//   for pass 1
+//
+//   Called w/ rcu_mutex held, by the polling thread each pass and by
+//   smr_barrier.
+//
+//   returns count of work queued
+//------------------------------------------------------------------------------
+int smr_drain(smr_domain_t *d) {
+	smr_node_t	*node;
+	smr_page_t	*page;
+	int			n = 0;
+
+	for (node = d->smr_node_queue; node != NULL; node = node->next)
+		n += smr_node_drain(d, node);
+
+	// shared free page goes on as newest
+	if ((page = d->free_page) != NULL) {
+		d->free_page = NULL;
+		smr_push(d, &page->defer, &page->defer);
+	}
+
+	if (d->smr_retired != NULL)
+		n += smr_queue(d, __atomic_exchange_n(&d->smr_retired, NULL, __ATOMIC_ACQUIRE));
+
+	return n;
+}
+
+
+//------------------------------------------------------------------------------
+// smr_incoming -- retired work not yet drained
+//
+//   Called w/ rcu_mutex held.
+//------------------------------------------------------------------------------
+int smr_incoming(smr_domain_t *d) {
+	smr_node_t	*node;
+
+	if (atomic_load(&d->smr_retired) != NULL || d->free_page != NULL)
+		return 1;
+
+	for (node = d->smr_node_queue; node != NULL; node = node->next)
+		if (atomic_load(&node->rhead) != NULL || atomic_load(&node->fpage) != NULL)
+			return 1;
+
+	return 0;
+}
+
+
+//------------------------------------------------------------------------------
+// smr_register -- register thread and initialize local data
+//
+//	note: quiesce point if node created
+//
+//   Called by smr_acquire, and by smr_retire and smr_defer_free so a
+//   thread's defers go on its retire list from the first one.
+//
+//   returns thread's node, NULL if no memory
+//------------------------------------------------------------------------------
+static smr_node_t * smr_node_register(smr_domain_t *d) {
+	smr_node_t	*node;
+
+	if ((node = (smr_node_t *)pthread_getspecific(d->smr_key)) != NULL)
+		return node;
+
+	// initialize TSD (per thread), hazard pointers on own cache lines
+	if (posix_memalign((void **)&node, 128, sizeof(smr_node_t)) != 0)
+		return NULL;
+
+	memset(node, 0, sizeof(smr_node_t));
+	node->ndx = 0;
+	node->hcount = SMR_BLOCK;
+	node->blocks[0] = node->hptr;
+	node->domain = d;
+
+	// debugging info
+	node->tid = pthread_self();
+
+	pthread_mutex_lockx(&d->rcu_mutex);
+
+	// add RCU node if RCU thread polling in effect
+	if (qcount_self(d->qcobj, &(node->qhandle))) {
+		qcount_set(d->qcobj);
+		rcu_add_node(d, node->qhandle);
+	}
+
+	if (pthread_setspecific(d->smr_key, (void *)node) != 0)
 		abort();
 
+	// push onto smr node queue
+	//
+
+	node->next = d->smr_node_queue;
+	node->prev = NULL;
+	if (d->smr_node_queue != NULL)
+		d->smr_node_queue->prev = node;
+	d->smr_node_queue = node;
+
+	pthread_mutex_unlockx(&d->rcu_mutex);
+
+	return node;
+}
+
+
+//------------------------------------------------------------------------------
+// smr_domain_acquire -- allocate a pair of hazard pointers, registering
+//   the thread if it isn't yet
+//------------------------------------------------------------------------------
+smr_t * smr_domain_acquire(smr_domain_t *d) {
+	smr_node_t	*node;
+	smr_t		*hptr;
+
+	if ((node = smr_node_register(d)) == NULL)
+		return NULL;
+
+	// return next available pair hazard pointer in array
+
+	if (node->ndx >= node->hcount && smr_grow(node) != 0)
+		abort();
+
+	hptr = smr_slot(node, node->ndx);
+	atomic_store_rel(&node->ndx, node->ndx + 2);	// smr_scan reads it
+
 	return hptr;
 
 }
 
+smr_t * smr_acquire() {
+	return smr_domain_acquire(smr_domain_default());
+}
+
+
+//-----------------------------------------------------------------------------
+// smr_sync_snap -- record every non-null hazard pointer for the
+//   smr_synchronize sentinel
+//
+//   Called by smr_scan the first time the sentinel is on smr_queue.  It
+//   got there after a pass 1 so every hazard pointer set before the
+//   grace period started is visible.
+//-----------------------------------------------------------------------------
+static void smr_sync_snap(smr_domain_t *d) {
+	smr_node_t	*node;
+	unsigned int	ndx;
+	unsigned int	j;
+	smr_t		p;
+
+	d->sync_nsnap = 0;
+	d->sync_snapped = 1;
+
+	for (node = d->smr_node_queue; node != NULL; node = node->next) {
+		ndx = atomic_load_acq(&node->ndx);
+		if (d->sync_snapsize - d->sync_nsnap < (int)ndx) {
+			d->sync_snapsize = (d->sync_snapsize * 2) + ndx;
+			d->sync_snap = (smr_snap_t *)realloc(d->sync_snap, d->sync_snapsize * sizeof(smr_snap_t));
+			if (d->sync_snap == NULL)
+				abort();
+		}
+		for (j = 0; j < ndx; j++) {
+			if ((p = atomic_load(smr_slot(node, j))) != NULL) {
+				d->sync_snap[d->sync_nsnap].node = node;
+				d->sync_snap[d->sync_nsnap].ndx = j;
+				d->sync_snap[d->sync_nsnap].hptr = p;
+				d->sync_nsnap++;
+			}
+		}
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// smr_sync_held -- any recorded hazard pointer still holding its value
+//
+//   Entries whose hazard pointer has changed are dropped, they can't
+//   hold the recorded value again for anything unlinked before the
+//   grace period.
+//
+//   returns 1 if the sentinel has to wait
+//-----------------------------------------------------------------------------
+static int smr_sync_held(smr_domain_t *d) {
+	smr_snap_t	*snap;
+	int			j = 0;
+
+	if (!d->sync_snapped)
+		smr_sync_snap(d);
+
+	while (j < d->sync_nsnap) {
+		snap = &d->sync_snap[j];
+		if (atomic_load(smr_slot(snap->node, snap->ndx)) == snap->hptr)
+			j++;
+		else
+			*snap = d->sync_snap[--d->sync_nsnap];	// released
+	}
+
+	return (d->sync_nsnap > 0);
+}
+
+
+//-----------------------------------------------------------------------------
+// smr_sync_forget -- drop exiting node's recorded hazard pointers
+//
+//   Called w/ rcu_mutex held before the node is freed.
+//-----------------------------------------------------------------------------
+static void smr_sync_forget(smr_domain_t *d, smr_node_t *node) {
+	int			j = 0;
+
+	while (j < d->sync_nsnap) {
+		if (d->sync_snap[j].node == node)
+			d->sync_snap[j] = d->sync_snap[--d->sync_nsnap];
+		else
+			j++;
+	}
+}
+
 
 //------------------------------------------------------------------------------
 // smr_release -- release thread smr node on thread exit
@@ -185,15 +682,24 @@ smr_t * smr_acquire() {
 //------------------------------------------------------------------------------
 void smr_release(void *tsd) {
 	smr_node_t	*node = (smr_node_t *)tsd;
+	smr_domain_t	*d;
 	rcu_defer_t * workqueue;
 	rcu_defer_t * work;
+	int			j;
 
 	if (node == NULL) {
 		abort();
 		return;
 	}
 
-	pthread_mutex_lockx(&rcu_mutex);
+	d = node->domain;
+
+	pthread_mutex_lockx(&d->rcu_mutex);
+
+	// polling thread picks it up after the broadcast below
+	smr_node_drain(d, node);
+	if (d->gp_start == 0 && d->deferred_work > 0)
+		d->gp_start = getutimeofday();
 
 	if (node->next != NULL)
 		node->next->prev = node->prev;
@@ -201,59 +707,80 @@ void smr_release(void *tsd) {
 	if (node->prev != NULL)
 		node->prev->next = node->next;
 	else
-		smr_node_queue = node->next;
+		d->smr_node_queue = node->next;
 
 
-	if (smr_node_queue == NULL) {
-		workqueue = fifo_dequeueall(&smr_queue);
+	if (d->smr_node_queue == NULL) {
+		workqueue = fifo_dequeueall(&d->smr_queue);
 		while((work = workqueue) != NULL) {
 			workqueue = work->next;			// dequeue
-			rcu_enqueue(work, pass2);
-			smr_count--;
+			rcu_enqueue(d, work, pass2);
+			d->smr_count--;
 		}
 		//pthread_cond_signal(&rcu_cvar);		// ??
 	}
 
-	rcu_delete_node(node->qhandle);
+	smr_sync_forget(d, node);
+	rcu_delete_node(d, node->qhandle);
+	qcount_release(d->qcobj, node->qhandle);
 
+	for (j = 1; j < (int)(node->hcount / SMR_BLOCK); j++)
+		free(node->blocks[j]);
 	free(node);
 
-	pthread_mutex_unlockx(&rcu_mutex);
-	pthread_cond_broadcast(&rcu_cvar);		// ??
+	pthread_mutex_unlockx(&d->rcu_mutex);
+	pthread_cond_broadcast(&d->rcu_cvar);		// ??
 
 	return;
 }
 
 
+//------------------------------------------------------------------------------
+// smr_domain_release -- release calling thread's smr node before exit
+//
+//------------------------------------------------------------------------------
+void smr_domain_release(smr_domain_t *d) {
+	smr_node_t	*node;
+
+	if ((node = (smr_node_t *)pthread_getspecific(d->smr_key)) == NULL)
+		return;
+
+	pthread_setspecific(d->smr_key, NULL);
+	smr_release(node);
+}
+
+
 //-----------------------------------------------------------------------------
 // smr_alloc --
 //-----------------------------------------------------------------------------
-smr_t *smr_alloc() {
+smr_t *smr_domain_alloc(smr_domain_t *d) {
 	smr_node_t	*node;
 	smr_t		*hptr;
 
-	if ((node = (smr_node_t *)pthread_getspecific(smr_key)) == NULL)
+	if ((node = (smr_node_t *)pthread_getspecific(d->smr_key)) == NULL)
 		return NULL;
 
-	// return next available hazard pointer in array
+	// return next available hazard pointer pair, growing if needed
 
-	if (node->ndx < node->hcount) {
-		hptr = &(node->hptr[2*node->ndx]);
-		node->ndx += 2;
-		// acquire membar
-	}
-
-	else
+	if (node->ndx >= node->hcount && smr_grow(node) != 0)
 		abort();
 
+	hptr = smr_slot(node, node->ndx);
+	atomic_store_rel(&node->ndx, node->ndx + 2);	// smr_scan reads it
+	// acquire membar
+
 	return hptr;
 }
 
+smr_t *smr_alloc() {
+	return smr_domain_alloc(smr_domain_default());
+}
+
 
 //-----------------------------------------------------------------------------
 // smr_dealloc --
 //-----------------------------------------------------------------------------
-void smr_dealloc(smr_t *hptr) {
+void smr_domain_dealloc(smr_domain_t *d, smr_t *hptr) {
 	smr_node_t	*node;
 
 	if (hptr == NULL)
@@ -261,31 +788,34 @@ void smr_dealloc(smr_t *hptr) {
 
 	smrnull(hptr);
 
-	if ((node = (smr_node_t *)pthread_getspecific(smr_key)) == NULL)
+	if ((node = (smr_node_t *)pthread_getspecific(d->smr_key)) == NULL)
 		return;
 
 	if (node->ndx == 0)
 		return;
 
-	// release membar ?
-	node->ndx -= 2;
+	atomic_store_rel(&node->ndx, node->ndx - 2);
 
-	if (hptr != &(node->hptr[2*node->ndx]))
+	if (hptr != smr_slot(node, node->ndx))
 		abort();
 
 	return;
 }
 
+void smr_dealloc(smr_t *hptr) {
+	smr_domain_dealloc(smr_domain_default(), hptr);
+}
+
 
 //-----------------------------------------------------------------------------
 // smr_check -- verify no hazard pointers are allocated
 //
 //   returns 0 if ok
 //-----------------------------------------------------------------------------
-int smr_check() {
+int smr_check(smr_domain_t *d) {
 	smr_node_t	*node;
 
-	if ((node = (smr_node_t *)pthread_getspecific(smr_key)) == NULL)
+	if ((node = (smr_node_t *)pthread_getspecific(d->smr_key)) == NULL)
 		return 0;
 
 	if (node->ndx == 0)
@@ -298,100 +828,185 @@ int smr_check() {
 //-----------------------------------------------------------------------------
 // smr_startup --
 //-----------------------------------------------------------------------------
-void smr_startup() {
-	// initialize TSD key (may fail if previously set)
-	pthread_key_create(&smr_key, &smr_release);
+void smr_startup(smr_domain_t *d) {
+	// initialize TSD key
+	if (pthread_key_create(&d->smr_key, &smr_release) != 0)
+		abort();
 
-	hptr = (smr_t *)malloc(50 * sizeof(smr_t));
-	hsize = 50;	
+	d->smr_node_queue = NULL;
+	fifo_init(&d->smr_queue);
+	d->current = 0;
+	d->smr_count = 0;
+
+	d->hptr = (smr_t *)malloc(50 * sizeof(smr_t));
+	d->hsize = 50;	
+	d->hcount = 0;
+
+	d->smr_retired = NULL;
+	d->free_page = NULL;
 }
 
 
 //-----------------------------------------------------------------------------
 // smr_shutdown --
 //-----------------------------------------------------------------------------
-void smr_shutdown() {
+void smr_shutdown(smr_domain_t *d) {
 	utime_t next;
 	struct timespec nexttime;
 
-	while (smr_node_queue != NULL) {
+	pthread_mutex_lockx(&d->rcu_mutex);
+	while (d->smr_node_queue != NULL) {
 		next = getutimeofday();
 		next += 10000;					// 10 msec
 
 		nexttime.tv_sec = utime_sec(next);
 		nexttime.tv_nsec = utime_nsec(next);
-		pthread_cond_timedwait(&rcu_cvar, &rcu_mutex, &nexttime);
+		pthread_cond_timedwait(&d->rcu_cvar, &d->rcu_mutex, &nexttime);
+	}
+	pthread_mutex_unlockx(&d->rcu_mutex);
+
+}
+
+
+//-----------------------------------------------------------------------------
+// smr_hptrcmp -- qsort compare for hazard pointer values
+//-----------------------------------------------------------------------------
+static int smr_hptrcmp(const void *a, const void *b) {
+	uintptr_t x = (uintptr_t)*(const smr_t *)a;
+	uintptr_t y = (uintptr_t)*(const smr_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+
+//-----------------------------------------------------------------------------
+// smr_hazardous -- binary search of sorted hazard pointer list
+//
+//   returns 1 if ptr is in list
+//-----------------------------------------------------------------------------
+static inline int smr_hazardous(smr_domain_t *d, void *ptr) {
+	smr_t *hptr = d->hptr;
+	unsigned int lo = 0;
+	unsigned int hi = d->hcount;
+	unsigned int mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if ((uintptr_t)hptr[mid] < (uintptr_t)ptr)
+			lo = mid + 1;
+		else
+			hi = mid;
 	}
 
+	return (lo < d->hcount && hptr[lo] == ptr);
+}
+
+
+//-----------------------------------------------------------------------------
+// smr_page_hazardous -- any of free page's pointers in hazard pointer list
+//-----------------------------------------------------------------------------
+static int smr_page_hazardous(smr_domain_t *d, smr_page_t *page) {
+	unsigned int	j;
+
+	if (d->hcount == 0)
+		return 0;
+
+	for (j = 0; j < page->count; j++)
+		if (smr_hazardous(d, page->ptr[j]))
+			return 1;
+
+	return 0;
 }
 
 
 //-----------------------------------------------------------------------------
 // smr_scan -- scan smr hazard pointers
 //
+//   The hazard pointers are copied and sorted once per scan so checking
+//   each piece of deferred work is a binary search, O(w log h) rather
+//   than O(w x h).  Null hazard pointers are not copied.
+//
 //-----------------------------------------------------------------------------
-void smr_scan() {
+void smr_scan(smr_domain_t *d) {
 	smr_node_t	*node;
 	rcu_defer_t	*work;
 	rcu_defer_t	*workqueue;
 	int			ndx;
 	int			j;
+	smr_t		p;
 
-	if (smr_count == 0) {
-		stats.smrempty++;
+	if (d->smr_count == 0) {
+		d->stats.smrempty++;
 		return;
 	}
 
-	current++;				// increment current sequence number
+	d->current++;			// increment current sequence number
+	smr_tracing = d;
 
 	//
 	// copy hazard pointer pairs
 	//
 
-	hcount = 0;
+	d->hcount = 0;
 
-	for ( node = smr_node_queue;
+	for ( node = d->smr_node_queue;
 		node != NULL;
 		node = node->next)
 	{
-		ndx = node->ndx;
+		ndx = atomic_load_acq(&node->ndx);
 		// acquire membar
-		if ((hsize - hcount) < ndx) {
-			hsize = (hsize * 2) + ndx;
-			hptr = (smr_t *)realloc(hptr, (hsize * sizeof(smr_t)));
-			if (hptr == NULL)
+		if ((d->hsize - d->hcount) < ndx) {
+			d->hsize = (d->hsize * 2) + ndx;
+			d->hptr = (smr_t *)realloc(d->hptr, (d->hsize * sizeof(smr_t)));
+			if (d->hptr == NULL)
 				abort();
 		}
 		for (j = 0; j < ndx; j += 2) {
-			hptr[hcount++] = atomic_load(&(node->hptr[j + 0]));
+			if ((p = atomic_load(smr_slot(node, j + 0))) != NULL)
+				d->hptr[d->hcount++] = p;
 			rmb();		// load/load memory barrier
-			hptr[hcount++] = atomic_load(&(node->hptr[j + 1]));
+			if ((p = atomic_load(smr_slot(node, j + 1))) != NULL)
+				d->hptr[d->hcount++] = p;
 		}
 	}
 
-	workqueue = fifo_dequeueall(&smr_queue);
+	if (d->hcount > 1)
+		qsort(d->hptr, d->hcount, sizeof(smr_t), &smr_hptrcmp);
+
+	workqueue = fifo_dequeueall(&d->smr_queue);
 
 	//
 	// mark all reachable nodes
 	//
 	for (work = workqueue; work != 0; work = work->next) {
 
-		for (j = 0; j < hcount && hptr[j] != work->arg; j++) {}
+		// smr_synchronize sentinel, held until the hazard pointers
+		// set when it got here have changed
+		if (work == &d->sync_work) {
+			if (smr_sync_held(d))
+				work->sequence = d->current;
+		}
+
+		// free page, held while any of its pointers is
+		else if (work->type == bulk) {
+			if (smr_page_hazardous(d, (smr_page_t *)work->arg))
+				work->sequence = d->current;
+		}
 
 		// work still referenced by hazard pointers
-		if (j < hcount) {
+		else if (smr_hazardous(d, work->arg)) {
 
 			switch (work->type) {
 
 			case trace:
-				work->sequence = current;
+				work->sequence = d->current;
 				work->forrefs(work->arg, &smr_tracecb); // trace reachable nodes
 				break;
 		
 			case fifo:
 				// old sequence # for first one
-				work->sequence = current;
-				*(work->psequence) = current;
+				work->sequence = d->current;
+				*(work->psequence) = d->current;
 				break;
 
 			default:
@@ -416,20 +1031,20 @@ void smr_scan() {
 	while((work = workqueue) != NULL) {
 		workqueue = work->next;		// dequeue
 
-		if (work->sequence == current)
-			fifo_enqueue(&smr_queue, work);		// requeue
+		if (work->sequence == d->current)
+			fifo_enqueue(&d->smr_queue, work);		// requeue
 		else
-			rcu_enqueue(work, pass2);			// dequeue
+			rcu_enqueue(d, work, pass2);			// dequeue
 	}
 
 
 	// update stats
 
-	if (smr_count != 0)
-		stats.smrpartial++;
+	if (d->smr_count != 0)
+		d->stats.smrpartial++;
 
 	else
-		stats.smrfull++;
+		d->stats.smrfull++;
 			
 	return;
 }
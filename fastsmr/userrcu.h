@@ -30,6 +30,7 @@ warranty.
 extern "C" {
 #endif
 
+#include <stdlib.h>
 #include <pthread.h>
 
 //#include <atomix.h>
@@ -70,27 +71,113 @@ extern void fifo_init(fifo_t *q);
 extern void fifo_enqueue(fifo_t *q, rcu_defer_t *item);
 extern rcu_defer_t *fifo_dequeue(fifo_t *q);
 extern rcu_defer_t *fifo_dequeueall(fifo_t *q);
+extern rcu_defer_t *fifo_dequeuen(fifo_t *q, int n, int *count);
 extern void fifo_requeue(fifo_t *dst, fifo_t *src);
 
 
 //------------------------------------------------------------------------------
-extern pthread_mutex_t	rcu_mutex;
-extern pthread_cond_t	rcu_cvar;
-extern pthread_key_t	rcu_restart_key;		// TSD key
-extern rcu_stats_t		stats;
-extern fifo_t			ready_queue;
-extern qcount_t			qcobj;					// qcount object
-extern sequence_t			current;				// current sequence number
-extern int				deferred_work;
+// hazard pointer held when an smr_synchronize grace period reached smr_scan
+//------------------------------------------------------------------------------
+typedef struct {
+	struct smr_node_tt	*node;		// owning thread's node
+	unsigned int	ndx;			// hazard pointer index in node
+	smr_t			hptr;			// value it held
+} smr_snap_t;
+
+
+//------------------------------------------------------------------------------
+// smr domain -- rcu/smr instance w/ its own hazard pointer registry,
+//   deferred work queues, stats and polling thread.  All fields except
+//   smr_retired and rcu_idle are protected by rcu_mutex.  Threads' retire
+//   lists are in their smr nodes.
+//------------------------------------------------------------------------------
+struct smr_domain_tt {
+	pthread_mutex_t	rcu_mutex;
+	pthread_cond_t	rcu_cvar;
+
+	rcu_stats_t		stats;				// rcu statistics
+	fifo_t			ready_queue;		// ready work
+	utime_t			rcu_minWait;		// minimum time to wait	(usec)
+	utime_t			rcu_waitFloor;		// min adaptive poll and qcount_set interval (usec)
+	utime_t			qcount_time;		// last qcount_set
+
+	// adaptive polling, off if rcu_targetLatency is 0
+	utime_t			rcu_targetLatency;	// target grace period latency (usec)
+	int				rcu_maxBacklog;		// target max deferred_work, 0 = none
+	utime_t			rcu_wait;			// poll interval for target latency (usec)
+	utime_t			gp_start;			// start of current grace period, 0 = none
+
+	// smr_synchronize -- one grace period in flight, callers arriving
+	//   after it started share the next one.  sync_started, sync_done
+	//   and sync_wanted are also used w/o rcu_mutex by smr_get_state and
+	//   smr_poll_state.
+	pthread_cond_t	sync_cvar;			// sync and barrier waiters
+	rcu_defer_t		sync_work;			// grace period sentinel
+	sequence_t		sync_started;		// grace periods started
+	sequence_t		sync_done;			// grace periods completed
+	int				sync_wanted;		// next grace period wanted
+
+	// hazard pointers the sentinel waits on, recorded at the first scan
+	//   the grace period is in
+	smr_snap_t		*sync_snap;
+	int				sync_nsnap;			// entries still held
+	int				sync_snapsize;		// allocated entries
+	int				sync_snapped;		// recorded for grace period in flight
+
+	// smr_barrier -- new work is tagged w/ barrier_gen, epochs up to
+	//   barrier_done have run.  At most 2 epochs open, counted by parity.
+	sequence_t		barrier_gen;		// current epoch
+	sequence_t		barrier_done;		// last epoch completed
+	int				barrier_count[2];	// outstanding work by epoch parity
+
+	// callback worker pool, ready work run inline by process_work if
+	//   rcu_workers is 0
+	int				rcu_workers;		// worker threads
+	int				worker_batch;		// max callbacks per worker batch
+	int				worker_stop;		// workers exit when queue empty
+	pthread_t		*worker_ids;
+	pthread_cond_t	worker_cvar;		// workers waiting for work
+	fifo_t			worker_queue;		// ready work handed to workers
+
+	pthread_t		rcu_poll_id;		// rcu polling thread
+	int				deferred_work;
+	qcount_t		qcobj;				// qcount object
+	int				rcu_stop;			// shutdown flag 0|1
+	int				rcu_idle;			// polling thread waiting for work
+
+	// rcu
+	struct rcu_node_tt	*current_node;
+
+	// smr
+	pthread_key_t	smr_key;			// thread's smr node
+	struct smr_node_tt	*smr_node_queue;	// SMR node list
+	fifo_t			smr_queue;			// SMR work queue
+	sequence_t		current;			// current sequence number
+	int				smr_count;			// count of deferred work
+
+	smr_t			*hptr;				// copied hazard pointer list, sorted
+	unsigned int	hsize;				// size of list
+	unsigned int	hcount;				// count of ptr's in list
+
+	rcu_defer_t		*smr_retired;		// full shared free pages, newest first
+	struct smr_page_tt	*free_page;		// smr_defer_free page, threads w/o smr node
+};
 
 //------------------------------------------------------------------------------
-extern void rcu_enqueue(rcu_defer_t *, rcu_defer_state_t);
-extern void smr_enqueue(rcu_defer_t *);
-extern void smr_scan();
-extern void rcu_scan();
-extern int smr_check();
-extern void rcu_shutdown2();
-extern int rcu_incoming();
+extern void rcu_enqueue(smr_domain_t *, rcu_defer_t *, rcu_defer_state_t);
+extern void smr_enqueue(smr_domain_t *, rcu_defer_t *);
+extern void smr_scan(smr_domain_t *);
+extern void rcu_scan(smr_domain_t *);
+extern int smr_check(smr_domain_t *);
+extern void smr_startup(smr_domain_t *);
+extern void smr_shutdown(smr_domain_t *);
+extern void rcu_shutdown2(smr_domain_t *);
+extern int rcu_incoming(smr_domain_t *);
+extern int smr_retire(smr_domain_t *, rcu_defer_t *);
+extern __thread int smr_service;		// polling thread or callback worker
+extern int smr_drain(smr_domain_t *);
+extern int smr_incoming(smr_domain_t *);
+extern void rcu_wakeup(smr_domain_t *);
 
 //------------------------------------------------------------------------------
 // forrefs callbacks
@@ -101,7 +188,8 @@ extern void smr_chgref_cb(rcu_defer_t *);
 
 
 //------------------------------------------------------------------------------
-extern void rcu_add_node(qhandle_t);
+extern void rcu_add_node(smr_domain_t *, qhandle_t);
+extern void rcu_delete_node(smr_domain_t *, qhandle_t);
 
 
 
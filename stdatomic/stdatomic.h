@@ -8,34 +8,52 @@
 #ifndef STDATOMIC_H
 #define	STDATOMIC_H
 
+#if defined(__cplusplus) && defined(__ATOMIC_RELAXED)
+/*
+ * C++ uses the <atomic> memory_order enumerators instead of defines so
+ * code can also pass std::memory_order_* values.  Memory order arguments
+ * are cast to int for the builtins.
+ */
+#include <atomic>
+using std::memory_order;
+using std::memory_order_relaxed;
+using std::memory_order_consume;
+using std::memory_order_acquire;
+using std::memory_order_release;
+using std::memory_order_acq_rel;
+using std::memory_order_seq_cst;
+#endif
+
 #ifdef	__cplusplus
 extern "C" {
 #endif
 
 #ifdef __ATOMIC_RELAXED
-    
+
+#ifndef __cplusplus
 #define memory_order_relaxed __ATOMIC_RELAXED
 #define memory_order_consume __ATOMIC_CONSUME
 #define memory_order_acquire __ATOMIC_ACQUIRE
 #define memory_order_release __ATOMIC_RELEASE
 #define memory_order_acq_rel __ATOMIC_ACQ_REL
 #define memory_order_seq_cst __ATOMIC_SEQ_CST
+#endif
 
-#define atomic_load_explicit(p, m) __atomic_load_n(p, m)
-#define atomic_store_explicit(p, v, m) __atomic_store_n(p, v, m)
+#define atomic_load_explicit(p, m) __atomic_load_n(p, (int)(m))
+#define atomic_store_explicit(p, v, m) __atomic_store_n(p, v, (int)(m))
 
-#define atomic_add_fetch_explicit(p, v, m) __atomic_add_fetch(p, v, m)
-#define atomic_fetch_add_explicit(p, v, m) __atomic_fetch_add(p, v, m)
-#define atomic_sub_fetch_explicit(p, v, m) __atomic_sub_fetch(p, v, m)
-#define atomic_fetch_sub_explicit(p, v, m) __atomic_fetch_sub(p, v, m)
+#define atomic_add_fetch_explicit(p, v, m) __atomic_add_fetch(p, v, (int)(m))
+#define atomic_fetch_add_explicit(p, v, m) __atomic_fetch_add(p, v, (int)(m))
+#define atomic_sub_fetch_explicit(p, v, m) __atomic_sub_fetch(p, v, (int)(m))
+#define atomic_fetch_sub_explicit(p, v, m) __atomic_fetch_sub(p, v, (int)(m))
 
-#define atomic_exchange_explicit(p, v, ms, mf) __atomic_exchange_n(p, v, ms, mf)
+#define atomic_exchange_explicit(p, v, m) __atomic_exchange_n(p, v, (int)(m))
 
-#define atomic_compare_exchange_strong_explicit(p, o, n, ms, mf) __atomic_compare_exchange_n(p, o, n, 0, ms, mf)
-#define atomic_compare_exchange_weak_explicit(p, o, n, ms, mf) __atomic_compare_exchange_n(p, o, n, 1, ms, mf)
+#define atomic_compare_exchange_strong_explicit(p, o, n, ms, mf) __atomic_compare_exchange_n(p, o, n, 0, (int)(ms), (int)(mf))
+#define atomic_compare_exchange_weak_explicit(p, o, n, ms, mf) __atomic_compare_exchange_n(p, o, n, 1, (int)(ms), (int)(mf))
 	
-#define atomic_thread_fence(m) __atomic_thread_fence(m)
-#define atomic_signal_fence(m) __atomic_signal_fence(m)
+#define atomic_thread_fence(m) __atomic_thread_fence((int)(m))
+#define atomic_signal_fence(m) __atomic_signal_fence((int)(m))
     
 #else
 
@@ -53,6 +53,9 @@ typedef struct _stpcProxy {
     //
     unsigned int	numNodes;		// current number of allocated nodes    
     //
+    long			queued;			// nodes queued, incremented before tail cas
+    long			released;		// nodes released, in queue order
+    //
     pthread_key_t   statsKey;
 	struct _stats_t	stats;
 } stpcProxy;
@@ -181,6 +184,7 @@ inline void _dropProxyNodeReference(stpcProxy* proxy, stpcNode* proxyNode, int a
 		atomic_thread_fence(memory_order_release);
 		next = node->next;
 		atomic_store_explicit(&proxy->freeTail, proxy->freeTail->next, memory_order_release);
+		atomic_fetch_add_explicit(&proxy->released, 1, memory_order_release);
 		node = next;
         
 		// free data queued for deferred deletion
@@ -214,6 +218,7 @@ void _queueNode(stpcProxy* proxy, stpcNode* newNode) {
 	
 	newTail.ptr = newNode;
 	newTail.sequence = 0;
+	atomic_fetch_add_explicit(&proxy->queued, 1, memory_order_seq_cst);	// cookie upper bound
 	oldTail.ival = atomic_load_explicit(&proxy->tail.ival, memory_order_consume);
 	do {
 		attempts++;
@@ -243,6 +248,45 @@ void stpcDeferredDelete(stpcProxy *proxy, void (*freeData)(void *), void *data,
     _queueNode(proxy, node);        
 }
 
+/*
+ * Queue an empty node so the tail node can be released once its
+ * readers are gone.  False if no node could be had (maxNodes).
+ */
+bool stpcAdvance(stpcProxy *proxy) {
+    stpcNode *node;
+
+    if ((node = _newNode(proxy, true)) == NULL)
+        return false;
+
+    _queueNode(proxy, node);        // no freeData
+    return true;
+}
+
+/*
+ * Polled grace period cookie
+ * Nodes are released in queue order.  A node a reader could reference
+ * when the cookie is taken has at most cookie nodes queued ahead of it
+ * (the initial node has none), so once more than cookie nodes have been
+ * released the reader is gone.  The cookie completes once the tail has
+ * moved past it, by a later deferred delete or stpcAdvance.  If nothing
+ * has been queued since the cookie the poll advances the tail itself.
+ */
+long stpcGetCookie(stpcProxy *proxy) {
+    atomic_thread_fence(memory_order_seq_cst);      // unlink before cookie
+    return atomic_load_explicit(&proxy->queued, memory_order_relaxed);
+}
+
+bool stpcPollCookie(stpcProxy *proxy, long cookie) {
+    if (COMPARE(atomic_load_explicit(&proxy->released, memory_order_acquire), cookie) > 0)
+        return true;
+
+    // tail is still the cookie's node, nothing else would release it
+    if (atomic_load_explicit(&proxy->queued, memory_order_relaxed) == cookie && !stpcAdvance(proxy))
+        return false;
+
+    return COMPARE(atomic_load_explicit(&proxy->released, memory_order_acquire), cookie) > 0;
+}
+
 unsigned int stpcTryDeleteProxyNodes(stpcProxy *proxy, unsigned int count) {
     unsigned int n = 0;
     unsigned int current = atomic_load_explicit(&proxy->numNodes, memory_order_relaxed);
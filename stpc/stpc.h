@@ -49,4 +49,13 @@ extern void stpcDeferredDelete(stpcProxy *proxy, void (*freeData)(void *), void
 
 extern unsigned int stpcTryDeleteProxyNodes(stpcProxy *proxy, unsigned int count);
 
+/*
+ * A cookie completes only once the tail node current when it was taken
+ * has been replaced and released.  stpcPollCookie replaces it itself
+ * if nothing has been queued since; stpcAdvance does so explicitly.
+ */
+extern long stpcGetCookie(stpcProxy *proxy);                // polled grace period cookie
+extern bool stpcPollCookie(stpcProxy *proxy, long cookie);  // true if cookie's readers are gone
+extern bool stpcAdvance(stpcProxy *proxy);                  // queue empty node, false if none
+
 #endif /* STPDR_H_ */
@@ -0,0 +1,768 @@
+/*
+   Copyright 2013 Joseph W. Seigh
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+/*
+ * atomic_ptr microbenchmarks
+ *
+ * g++ -std=c++11 -O2 -mcx16 -DATOMIC_PTR_CASCOUNT -I../stdatomic -I../atomic-ptr \
+ *     atomicptrtest.cpp -o atomicptrtest -lpthread -latomic
+ *
+ * add -DATOMIC_PTR_PACKED_REFCOUNT to use single word refcounts
+ * add -DATOMIC_PTR_UPDATE_STATS to count atomic_ptr::update cas failures
+ * add -DATOMIC_PTR_STATS for per call site retry counts and histograms
+ * and the slots w/ the most retries
+ * use -std=c++20 to add std::atomic<std::shared_ptr> comparison testcases
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include <sys/time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <memory>
+
+#include <atomic_ptr.h>
+#include <atomic_ptr_pool.h>
+#include <distributed_atomic_ptr.h>
+#include <atomic_weak_ptr.h>
+
+typedef struct _data_t {
+    _data_t(long v = 0) : val(v) {}
+    long val;
+} data_t;
+
+static atomic_ptr<data_t> slot;            // shared publish slot
+static atomic_ptr<data_t, packedReference> pslot;   // single word slot
+static distributed_atomic_ptr<data_t> dslot;        // per cpu stripes
+static atomic_weak_ptr<data_t> wslot;               // weak ref to slot object
+static atomic_ptr<data_t, differentialReference, ordering::consume_loads> cslot;
+static atomic_ptr<data_t, differentialReference, ordering::seq_cst> qslot;
+#if __cplusplus >= 202002L
+static std::atomic<std::shared_ptr<data_t>> sslot;  // std comparison
+#endif
+static volatile bool run = true;
+
+typedef struct _testparm {
+    pthread_t   tid;
+    int         id;
+    long        count;
+
+    long        ops;            // publishes or reads
+    long        cas;            // interlocked refcount/link updates
+} testparm;
+
+uint64_t gettimemillisec() {
+    struct timeval t;
+    gettimeofday(&t, NULL);
+    return (uint64_t)(t.tv_sec * 1000 + (t.tv_usec/1000));
+}
+
+static inline long cascount() {
+#ifdef ATOMIC_PTR_CASCOUNT
+    return atomic_ptr_cascount();
+#else
+    return 0;
+#endif
+}
+
+// factory as used on publish path
+local_ptr<data_t> newData(long val) {
+    local_ptr<data_t> item(new data_t);
+    item->val = val;
+    return item;
+}
+
+//--------------------------------------------------------------------
+// publish w/ copy semantics
+//--------------------------------------------------------------------
+void *testPublishCopy(void *arg) {
+    testparm *parm = (testparm *) arg;
+    long cas0 = cascount();
+
+    for (long j = 0; j < parm->count; j++) {
+        local_ptr<data_t> item(new data_t);
+        item->val = j;
+        slot = item;                        // adjust(0, +1), ~local_ptr adjust_mb(-1, 0)
+        parm->ops++;
+    }
+
+    parm->cas = cascount() - cas0;
+    return NULL;
+}
+
+//--------------------------------------------------------------------
+// publish w/ move semantics
+//--------------------------------------------------------------------
+void *testPublishMove(void *arg) {
+    testparm *parm = (testparm *) arg;
+    long cas0 = cascount();
+
+    for (long j = 0; j < parm->count; j++) {
+        slot.store(newData(j));             // ownership transfer, no adjust
+        parm->ops++;
+    }
+
+    parm->cas = cascount() - cas0;
+    return NULL;
+}
+
+//--------------------------------------------------------------------
+// publish w/ move semantics, object and refcount in single allocation
+//--------------------------------------------------------------------
+void *testPublishMake(void *arg) {
+    testparm *parm = (testparm *) arg;
+    long cas0 = cascount();
+
+    for (long j = 0; j < parm->count; j++) {
+        slot.store(make_local<data_t>(j));
+        parm->ops++;
+    }
+
+    parm->cas = cascount() - cas0;
+    return NULL;
+}
+
+//--------------------------------------------------------------------
+// publish w/ move semantics, ref and object allocated w/ allocator
+//--------------------------------------------------------------------
+void *testPublishAllocate(void *arg) {
+    testparm *parm = (testparm *) arg;
+    std::allocator<data_t> alloc;
+    long cas0 = cascount();
+
+    for (long j = 0; j < parm->count; j++) {
+        slot.store(allocate_local<data_t>(alloc, j));
+        parm->ops++;
+    }
+
+    parm->cas = cascount() - cas0;
+    return NULL;
+}
+
+//--------------------------------------------------------------------
+// publish w/ move semantics, custom deleter
+//--------------------------------------------------------------------
+struct data_deleter {
+    void operator () (data_t *p) const { p->val = -1; delete p; }
+};
+
+void *testPublishDeleter(void *arg) {
+    testparm *parm = (testparm *) arg;
+    long cas0 = cascount();
+
+    for (long j = 0; j < parm->count; j++) {
+        slot.store(local_ptr<data_t>(new data_t(j), data_deleter()));
+        parm->ops++;
+    }
+
+    parm->cas = cascount() - cas0;
+    return NULL;
+}
+
+//--------------------------------------------------------------------
+// publish into single word slot
+//--------------------------------------------------------------------
+void *testPublishPacked(void *arg) {
+    testparm *parm = (testparm *) arg;
+    long cas0 = cascount();
+
+    for (long j = 0; j < parm->count; j++) {
+        pslot.store(make_local<data_t>(j));
+        parm->ops++;
+    }
+
+    parm->cas = cascount() - cas0;
+    return NULL;
+}
+
+//--------------------------------------------------------------------
+// publish w/ refs recycled through atomic_ptr_pool
+//--------------------------------------------------------------------
+void *testPublishPool(void *arg) {
+    testparm *parm = (testparm *) arg;
+    long cas0 = cascount();
+
+    for (long j = 0; j < parm->count; j++) {
+        local_ptr<data_t> item = atomic_ptr_pool<data_t>::get();
+        item->val = j;
+        slot.store(std::move(item));
+        parm->ops++;
+    }
+
+    parm->cas = cascount() - cas0;
+    return NULL;
+}
+
+//--------------------------------------------------------------------
+// publish into per cpu striped slot
+//--------------------------------------------------------------------
+void *testPublishDistributed(void *arg) {
+    testparm *parm = (testparm *) arg;
+    long cas0 = cascount();
+
+    for (long j = 0; j < parm->count; j++) {
+        dslot.store(make_local<data_t>(j));
+        parm->ops++;
+    }
+
+    parm->cas = cascount() - cas0;
+    return NULL;
+}
+
+//--------------------------------------------------------------------
+// read-copy-update increment w/ atomic_ptr::update
+//--------------------------------------------------------------------
+void *testUpdate(void *arg) {
+    testparm *parm = (testparm *) arg;
+    long cas0 = cascount();
+
+    for (long j = 0; j < parm->count; j++) {
+        slot.update([](const data_t & old) { return make_local<data_t>(old.val + 1); });
+        parm->ops++;
+    }
+
+    parm->cas = cascount() - cas0;
+    return NULL;
+}
+
+//--------------------------------------------------------------------
+// atomic_ptr::update edge cases, returns # of failed checks
+//--------------------------------------------------------------------
+int checkUpdate() {
+    atomic_ptr<data_t> empty;
+    atomic_ptr<data_t> item(newData(1));
+    int calls = 0;
+    int errors = 0;
+
+    auto copy = [&](const data_t & old) { calls++; return make_local<data_t>(old.val + 1); };
+    auto inplace = [&](const data_t & old, data_t & next) { calls++; next.val = old.val + 1; };
+
+    // null atomic_ptr, fn not called
+    if (empty.update(copy) || empty.update(make_local<data_t>(0), inplace) || calls != 0)
+        errors++;
+
+    // null next, fn not called and value unchanged
+    if (item.update(local_ptr<data_t>(), inplace) || calls != 0 || item->val != 1)
+        errors++;
+
+    // both forms
+    if (!item.update(copy) || item->val != 2)
+        errors++;
+    if (!item.update(make_local<data_t>(0), inplace) || item->val != 3 || calls != 2)
+        errors++;
+
+    return errors;
+}
+
+//--------------------------------------------------------------------
+// distributed_atomic_ptr stripe refs.  The stored object has to live
+// until the last local_ptr loaded from any stripe is dropped, and be
+// destroyed exactly once.  Returns # of failed checks.
+//--------------------------------------------------------------------
+static long dreclaimed = 0;
+
+struct countDelete {
+    void operator () (data_t * p) { dreclaimed++; delete p; }
+};
+
+int checkDistributed() {
+    distributed_atomic_ptr<data_t> d(nullptr, 4);
+    int n = d.getStripes();
+    int errors = 0;
+
+    // null stores load null from every stripe
+    for (int j = 0; j < n; j++)
+        if (d.load(j))
+            errors++;
+
+    {
+        local_ptr<data_t> item(new data_t(7), countDelete());
+        local_ptr<data_t> held[4];
+
+        d.store(item);
+        item.reset();
+        for (int j = 0; j < n; j++) {
+            held[j] = d.load(j);
+            if (held[j].get() != held[0].get() || held[j]->val != 7)
+                errors++;
+        }
+
+        d = newData(8);             // stripes swapped out
+        if (dreclaimed != 0 || d.load(1)->val != 8)
+            errors++;
+
+        for (int j = 0; j < n - 1; j++)
+            held[j].reset();
+        if (dreclaimed != 0 || held[n - 1]->val != 7)
+            errors++;
+    }
+    if (dreclaimed != 1)
+        errors++;
+
+    d = (data_t *)nullptr;
+    return errors;
+}
+
+//--------------------------------------------------------------------
+// pooled ref dropped by a static destructor, after the main thread's
+// pool cache is gone.  The ref has to be deleted, not put in a
+// magazine the depot owns.
+//--------------------------------------------------------------------
+static long exitdeleted = 0;
+
+struct exitdata_t {
+    exitdata_t(long v = 0) : val(v) {}
+    ~exitdata_t() { exitdeleted++; }
+    long val;
+};
+
+static struct poolexit_t {
+    atomic_ptr<exitdata_t> slot;
+
+    void setup() {
+        local_ptr<exitdata_t> cached = atomic_ptr_pool<exitdata_t>::get();
+        slot = atomic_ptr_pool<exitdata_t>::get();
+        // cached goes to the thread's magazine
+    }
+
+    ~poolexit_t() {
+        long n = exitdeleted;
+
+        slot = (exitdata_t *)nullptr;
+        if (exitdeleted != n + 1) {
+            fprintf(stderr, "pooled ref dropped at exit not deleted\n");
+            _exit(1);
+        }
+    }
+} poolexit;
+
+//--------------------------------------------------------------------
+// notify_one w/ two atomic_ptrs in the same wait bucket.  wq[0] and
+// wq[nbuckets] hash alike.  Each is changed and notified once and
+// both waiters have to return.  Returns # of failed checks.
+//--------------------------------------------------------------------
+static atomic_ptr<data_t> wq[atomic_ptr_waitq::nbuckets + 1];
+static int waitdone[2];
+
+void *testWaiter(void *arg) {
+    long k = (long)arg;
+    atomic_ptr<data_t> & w = wq[k * atomic_ptr_waitq::nbuckets];
+
+    w.wait(w.load());
+    __atomic_store_n(&waitdone[k], 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+int checkNotify() {
+    atomic_ptr<data_t> & a = wq[0];
+    atomic_ptr<data_t> & b = wq[atomic_ptr_waitq::nbuckets];
+    atomic_ptr_waitq::bucket & q = atomic_ptr_waitq::get(&a);
+    pthread_t tid[2];
+    int j;
+
+    if (&q != &atomic_ptr_waitq::get(&b))
+        return 1;
+
+    a = newData(0);
+    b = newData(0);
+
+    // a's waiter blocks first so a futex wake of 1 would pick it
+    for (long k = 0; k < 2; k++) {
+        pthread_create(&tid[k], NULL, testWaiter, (void *)k);
+        while (__atomic_load_n(&q.waiters, __ATOMIC_RELAXED) < k + 1)
+            sched_yield();
+        usleep(10000);
+    }
+
+    b.store(newData(1));
+    b.notify_one();
+    usleep(10000);
+    a.store(newData(1));
+    a.notify_one();
+
+    for (j = 0; j < 2000; j++) {
+        if (__atomic_load_n(&waitdone[0], __ATOMIC_ACQUIRE) && __atomic_load_n(&waitdone[1], __ATOMIC_ACQUIRE))
+            break;
+        usleep(1000);
+    }
+    if (j == 2000)
+        return 1;                   // waiter stuck, exit w/o joining
+
+    pthread_join(tid[0], NULL);
+    pthread_join(tid[1], NULL);
+    a = (data_t *)nullptr;
+    b = (data_t *)nullptr;
+
+    return 0;
+}
+
+//--------------------------------------------------------------------
+// publish into slot and weak ref to it into wslot
+//--------------------------------------------------------------------
+void *testPublishWeak(void *arg) {
+    testparm *parm = (testparm *) arg;
+    long cas0 = cascount();
+
+    for (long j = 0; j < parm->count; j++) {
+        local_ptr<data_t> item = make_local<data_t>(j);
+        wslot = item;
+        slot.store(std::move(item));
+        parm->ops++;
+    }
+
+    parm->cas = cascount() - cas0;
+    return NULL;
+}
+
+//--------------------------------------------------------------------
+// publish w/ std::atomic<std::shared_ptr> compatible api, same code
+// for atomic_ptr and the std type
+//--------------------------------------------------------------------
+template<typename S, typename P> void *testPublishStd(S & slot, P (*make)(long), testparm *parm) {
+    long cas0 = cascount();
+
+    for (long j = 0; j < parm->count; j++) {
+        slot.store(make(j), std::memory_order_release);
+        parm->ops++;
+    }
+
+    parm->cas = cascount() - cas0;
+    return NULL;
+}
+
+local_ptr<data_t> makeLocal(long val) { return make_local<data_t>(val); }
+void *testPublishCompat(void *arg) { return testPublishStd(slot, makeLocal, (testparm *)arg); }
+#if __cplusplus >= 202002L
+std::shared_ptr<data_t> makeShared(long val) { return std::make_shared<data_t>(val); }
+void *testPublishShared(void *arg) { return testPublishStd(sslot, makeShared, (testparm *)arg); }
+#endif
+
+//--------------------------------------------------------------------
+// publish make_local by move into slot w/ ordering policy
+//--------------------------------------------------------------------
+template<typename S> void *testPublishOrdered(S & slot, testparm *parm) {
+    long cas0 = cascount();
+
+    for (long j = 0; j < parm->count; j++) {
+        slot.store(make_local<data_t>(j));
+        parm->ops++;
+    }
+
+    parm->cas = cascount() - cas0;
+    return NULL;
+}
+
+void *testPublishConsume(void *arg) { return testPublishOrdered(cslot, (testparm *)arg); }
+void *testPublishSeqCst(void *arg) { return testPublishOrdered(qslot, (testparm *)arg); }
+
+//--------------------------------------------------------------------
+// readers
+//--------------------------------------------------------------------
+template<typename S> void *testRead(S & slot, testparm *parm) {
+    long cas0 = cascount();
+
+    while (run) {
+        if (slot->val < 0)
+            abort();
+        parm->ops++;
+    }
+
+    parm->cas = cascount() - cas0;
+    return NULL;
+}
+
+void *testRead(void *arg) { return testRead(slot, (testparm *)arg); }
+void *testReadPacked(void *arg) { return testRead(pslot, (testparm *)arg); }
+void *testReadDistributed(void *arg) { return testRead(dslot, (testparm *)arg); }
+void *testReadConsume(void *arg) { return testRead(cslot, (testparm *)arg); }
+void *testReadSeqCst(void *arg) { return testRead(qslot, (testparm *)arg); }
+
+// reads w/ local_ptr drops batched, 64 reads per batch scope
+void *testReadBatch(void *arg) {
+    testparm *parm = (testparm *) arg;
+    long cas0 = cascount();
+
+    while (run) {
+        local_ptr_batch batch;
+        for (int k = 0; k < 64; k++) {
+            if (slot->val < 0)
+                abort();
+            parm->ops++;
+        }
+    }
+
+    parm->cas = cascount() - cas0;
+    return NULL;
+}
+
+template<typename S> void *testLoad(S & slot, testparm *parm) {
+    long cas0 = cascount();
+
+    while (run) {
+        if (slot.load(std::memory_order_acquire)->val < 0)
+            abort();
+        parm->ops++;
+    }
+
+    parm->cas = cascount() - cas0;
+    return NULL;
+}
+
+void *testLoadCompat(void *arg) { return testLoad(slot, (testparm *)arg); }
+#if __cplusplus >= 202002L
+void *testLoadShared(void *arg) { return testLoad(sslot, (testparm *)arg); }
+#endif
+
+void *testReadWeak(void *arg) {
+    testparm *parm = (testparm *) arg;
+    long cas0 = cascount();
+
+    while (run) {
+        local_ptr<data_t> item = wslot.lock();
+        if (item != nullptr && item->val < 0)
+            abort();
+        parm->ops++;
+    }
+
+    parm->cas = cascount() - cas0;
+    return NULL;
+}
+
+testparm *starttest(int num, void *(*test)(void *), long count) {
+    testparm *parms = (testparm *)malloc(num * sizeof(testparm));
+    memset(parms, 0, num * sizeof(testparm));
+
+    for (int j = 0; j < num; j++) {
+        testparm *parm = &parms[j];
+        parm->id = j;
+        parm->count = count;
+        pthread_create(&parm->tid, NULL, test, parm);
+    }
+
+    return parms;
+}
+
+void endtest(int num, testparm *parms, testparm *result) {
+    for (int j = 0; j < num; j++) {
+        testparm *parm = &parms[j];
+        pthread_join(parm->tid, NULL);
+        result->ops += parm->ops;
+        result->cas += parm->cas;
+    }
+    free(parms);
+}
+
+
+const char* testdesc[] = {
+    "publish local_ptr by copy",
+    "publish local_ptr by move",
+    "publish make_local by move",
+    "publish make_local by move, packedReference slot",
+    "publish atomic_ptr_pool refs by move",
+    "publish make_local by move, distributed_atomic_ptr slot",
+    "read-copy-update increment w/ update",
+    "publish make_local by move w/ weak ref, lock weak ref",
+    "publish/load w/ std::atomic<std::shared_ptr> api, atomic_ptr",
+    "publish make_local by move, ordering::consume_loads slot",
+    "publish make_local by move, ordering::seq_cst slot",
+    "publish make_local by move, reads in local_ptr_batch scope",
+    "publish allocate_local by move, std::allocator",
+    "publish local_ptr w/ custom deleter by move",
+#if __cplusplus >= 202002L
+    "publish/load w/ std::atomic<std::shared_ptr> api, std type",
+#endif
+};
+void *(*writeTest[])(void *) = {
+    testPublishCopy,
+    testPublishMove,
+    testPublishMake,
+    testPublishPacked,
+    testPublishPool,
+    testPublishDistributed,
+    testUpdate,
+    testPublishWeak,
+    testPublishCompat,
+    testPublishConsume,
+    testPublishSeqCst,
+    testPublishMake,
+    testPublishAllocate,
+    testPublishDeleter,
+#if __cplusplus >= 202002L
+    testPublishShared,
+#endif
+};
+void *(*readTest[])(void *) = {
+    testRead,
+    testRead,
+    testRead,
+    testReadPacked,
+    testRead,
+    testReadDistributed,
+    testRead,
+    testReadWeak,
+    testLoadCompat,
+    testReadConsume,
+    testReadSeqCst,
+    testReadBatch,
+    testRead,
+    testRead,
+#if __cplusplus >= 202002L
+    testLoadShared,
+#endif
+};
+int max_test_number = sizeof(testdesc)/sizeof(char*);
+
+void runtest(int test_num, long count, int num_writers, int num_readers) {
+    testparm wresult, rresult;
+    memset(&wresult, 0, sizeof(wresult));
+    memset(&rresult, 0, sizeof(rresult));
+
+    printf("count=%ld, writers=%d, readers=%d\n", count, num_writers, num_readers);
+
+    run = true;
+    atomic_ptr_stats_reset();
+    uint64_t t0 = gettimemillisec();
+    testparm *readparms = starttest(num_readers, readTest[test_num], 0);
+    testparm *writeparms = starttest(num_writers, writeTest[test_num], count);
+    endtest(num_writers, writeparms, &wresult);
+    run = false;
+    uint64_t t1 = gettimemillisec();
+    endtest(num_readers, readparms, &rresult);
+
+    long elapsed = (t1 > t0) ? (long)(t1 - t0) : 1;
+
+    printf("publishes = %ld, elapsed time = %ld msec, publishes/msec = %6.4f\n",
+            wresult.ops, elapsed, (double)wresult.ops/(double)elapsed);
+#ifdef ATOMIC_PTR_CASCOUNT
+    printf("interlocked ops/publish = %5.3f\n", (double)wresult.cas/(double)wresult.ops);
+#endif
+    if (num_readers > 0) {
+        printf("reads = %ld, reads/msec = %6.4f, reads/msec/thread = %6.4f\n", rresult.ops,
+                (double)rresult.ops/(double)elapsed, (double)rresult.ops/(double)elapsed/(double)num_readers);
+#ifdef ATOMIC_PTR_CASCOUNT
+        printf("interlocked ops/read = %5.3f\n", (double)rresult.cas/(double)rresult.ops);
+#endif
+    }
+#ifdef ATOMIC_PTR_UPDATE_STATS
+    if (slot.getUpdateAttempts() > 0)
+        printf("update attempts = %ld, failures = %ld\n", slot.getUpdateAttempts(), slot.getUpdateFailures());
+#endif
+#ifdef ATOMIC_PTR_STATS
+    atomic_ptr_stats_dump(stdout);
+#endif
+}
+
+
+int main(int argc, char **argv) {
+    int     n;
+    int     help = 0;
+
+    long    count = 1000000;    // default loop count
+    int     num_writers = 1;
+    int     num_readers = 0;
+    int     test_num = 0;
+    int     sweep = 0;          // run w/ 1 .. num_readers readers
+
+    while ((n = getopt(argc, argv, "t:n:hr:w:s")) > -1) {
+        switch ((char)n) {
+            case 't':
+                test_num = atoi(optarg);
+                break;
+
+            case 'n':
+                count = atol(optarg);
+                break;
+
+            case 'w':
+                num_writers = atoi(optarg);
+                break;
+
+            case 'r':
+                num_readers = atoi(optarg);
+                break;
+
+            case 's':
+                sweep = 1;
+                break;
+
+            case 'h':
+            case '?':
+            default:
+                help = 1;
+                break;
+        }
+    }
+
+    if (help || test_num < 0 || test_num >= max_test_number) {
+        fprintf(stderr, "usage %s <options>\n", argv[0]);
+        fprintf(stderr, "where options are:\n");
+        fprintf(stderr, "\t-n : number of iterations\n");
+        fprintf(stderr, "\t-w : number of writer threads\n");
+        fprintf(stderr, "\t-r : number of reader threads\n");
+        fprintf(stderr, "\t-s : scaling, repeat w/ 1 to -r reader threads\n");
+        fprintf(stderr, "\t-t : testcase # default 0\n");
+        for (int j = 0; j < max_test_number; j++) {
+            fprintf(stderr, "\t\ttestcase %d: %s\n", j, testdesc[j]);
+        }
+        exit(1);
+    }
+
+    if (checkUpdate() != 0) {
+        fprintf(stderr, "atomic_ptr::update edge case checks failed\n");
+        exit(1);
+    }
+    if (checkDistributed() != 0) {
+        fprintf(stderr, "distributed_atomic_ptr stripe ref checks failed\n");
+        exit(1);
+    }
+    poolexit.setup();
+    if (checkNotify() != 0) {
+        fprintf(stderr, "notify_one lost a wakeup w/ a shared wait bucket\n");
+        exit(1);
+    }
+
+    printf("testcase %d: %s\n", test_num, testdesc[test_num]);
+
+    slot = newData(0);
+    pslot = newData(0);
+    dslot = newData(0);
+    cslot = newData(0);
+    qslot = newData(0);
+#if __cplusplus >= 202002L
+    sslot = std::make_shared<data_t>(0);
+#endif
+
+    if (sweep) {
+        for (int j = 1; j <= num_readers; j++)
+            runtest(test_num, count, num_writers, j);
+    }
+    else
+        runtest(test_num, count, num_writers, num_readers);
+
+    slot = (data_t *)nullptr;
+    pslot = (data_t *)nullptr;
+    dslot = (data_t *)nullptr;
+    cslot = (data_t *)nullptr;
+    qslot = (data_t *)nullptr;
+    wslot = local_ptr<data_t>();
+
+    return 0;
+}
+
+/*-*/
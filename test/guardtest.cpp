@@ -0,0 +1,265 @@
+/*
+   Copyright 2013 Joseph W. Seigh
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+/*
+ * atomic_ptr_guard hazard pointer reads.  Checks that guards nested
+ * past a hazard pointer pair, moved by borrow and dropped out of order
+ * keep their objects from being reclaimed after the slots are replaced,
+ * that promote fails once the refcount is zero, and that everything is
+ * reclaimed once the guards are gone.  Then readers borrow nested
+ * guards while writers replace the slots.
+ *
+ * g++ -std=c++11 -O2 -mcx16 -I../stdatomic -I../atomic-ptr -I../fastsmr \
+ *     guardtest.cpp -o guardtest -L. -lfastsmr -lpthread -latomic
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include <atomic_ptr.h>
+#include <atomic_ptr_smr.h>
+
+#define MAGIC   0x5eed5eedL
+#define NSLOTS  8
+#define DEPTH   5               // nested guards, > one hazard pointer pair
+
+typedef struct _data_t {
+    _data_t(long v = 0) : val(v), magic(MAGIC) { __atomic_fetch_add(&created, 1, __ATOMIC_RELAXED); }
+    ~_data_t() { magic = 0; __atomic_fetch_add(&destroyed, 1, __ATOMIC_RELAXED); }
+
+    long val;
+    long magic;
+
+    static long created;
+    static long destroyed;
+} data_t;
+
+long data_t::created = 0;
+long data_t::destroyed = 0;
+
+typedef atomic_ptr_guard<data_t> guard_t;
+
+static atomic_ptr<data_t> slots[NSLOTS];
+static int errors = 0;
+static volatile bool run = true;
+
+static void check(bool ok, const char * what) {
+    if (!ok) {
+        printf("error: %s\n", what);
+        errors++;
+    }
+}
+
+static void replace(int j, long val) {
+    slots[j] = atomic_ptr_smr<data_t>::make(val);
+}
+
+// let deferred deletes that aren't held run.  Not smr_synchronize,
+// which waits for the caller's own guards.
+static void settle() {
+    usleep(50000);
+}
+
+static bool intact(guard_t & g, long val) {
+    return g.get() != nullptr && g->magic == MAGIC && g->val == val;
+}
+
+//--------------------------------------------------------------------
+// nest -- DEPTH guards on slots 0 .. DEPTH-1, replace them all at the
+// innermost level and check every guard still sees its object
+//--------------------------------------------------------------------
+static void nest(int depth) {
+    guard_t g = borrow(slots[depth]);
+    long val = g->val;
+
+    if (depth + 1 < DEPTH)
+        nest(depth + 1);
+    else {
+        for (int j = 0; j < DEPTH; j++)
+            replace(j, 100 + j);
+        settle();
+    }
+
+    check(intact(g, val), "nested guard's object reclaimed");
+}
+
+//--------------------------------------------------------------------
+// outoforder -- first guard dropped while later ones are live, its
+// hazard pointer reused by the next guard
+//--------------------------------------------------------------------
+static void outoforder() {
+    guard_t g1 = borrow(slots[0]);
+    guard_t g2 = borrow(slots[1]);
+    guard_t g3 = borrow(slots[2]);
+    long v2 = g2->val, v3 = g3->val;
+
+    {
+        guard_t moved(std::move(g1));
+        check(g1.get() == nullptr, "moved from guard not empty");
+    }
+
+    guard_t g4 = borrow(slots[3]);
+    long v4 = g4->val;
+
+    replace(1, 201);
+    replace(2, 202);
+    replace(3, 203);
+    settle();
+
+    check(intact(g2, v2), "guard reclaimed after earlier guard dropped");
+    check(intact(g3, v3), "guard reclaimed after earlier guard dropped");
+    check(intact(g4, v4), "guard w/ reused hazard pointer reclaimed");
+}
+
+//--------------------------------------------------------------------
+// promote -- local_ptr from a guard outlives the guard and the slot,
+// and fails once the slot's link was the last reference
+//--------------------------------------------------------------------
+static void promote() {
+    local_ptr<data_t> held;
+
+    {
+        guard_t g = borrow(slots[4]);
+        held = g.promote();
+        check(held != nullptr, "promote of live object failed");
+        replace(4, 304);
+    }
+    settle();
+    check(held->magic == MAGIC, "promoted object reclaimed");
+
+    guard_t g = borrow(slots[5]);
+    long val = g->val;
+    replace(5, 305);
+    check(g.promote() == nullptr, "promote after refcount zero succeeded");
+    settle();
+    check(intact(g, val), "guard w/ zero refcount object reclaimed");
+}
+
+//--------------------------------------------------------------------
+// reader -- nested borrows while writers replace the slots
+//--------------------------------------------------------------------
+static void *reader(void *arg) {
+    long n = 0;
+
+    while (run) {
+        guard_t g1 = borrow(slots[n % NSLOTS]);
+        guard_t g2 = borrow(slots[(n + 1) % NSLOTS]);
+        {
+            guard_t g3 = borrow(slots[(n + 2) % NSLOTS]);
+            if (g3->magic != MAGIC)
+                abort();
+            guard_t g4(std::move(g1));      // first guard outlives g3
+            if (g4->magic != MAGIC)
+                abort();
+        }
+        if (g2->magic != MAGIC)
+            abort();
+        n++;
+    }
+
+    return NULL;
+}
+
+static void *writer(void *arg) {
+    long count = *(long *)arg;
+
+    for (long j = 0; j < count; j++)
+        replace(j % NSLOTS, j);
+
+    return NULL;
+}
+
+
+int main(int argc, char **argv) {
+    int     n;
+    int     help = 0;
+    long    count = 100000;     // replaces per writer
+    int     num_writers = 1;
+    int     num_readers = 2;
+
+    while ((n = getopt(argc, argv, "n:hr:w:")) > -1) {
+        switch ((char)n) {
+            case 'n':
+                count = atol(optarg);
+                break;
+
+            case 'w':
+                num_writers = atoi(optarg);
+                break;
+
+            case 'r':
+                num_readers = atoi(optarg);
+                break;
+
+            case 'h':
+            case '?':
+            default:
+                help = 1;
+                break;
+        }
+    }
+
+    if (help || count < 0 || num_writers < 0 || num_readers < 0) {
+        fprintf(stderr, "usage %s <options>\n", argv[0]);
+        fprintf(stderr, "where options are:\n");
+        fprintf(stderr, "\t-n : number of replaces per writer\n");
+        fprintf(stderr, "\t-w : number of writer threads\n");
+        fprintf(stderr, "\t-r : number of reader threads\n");
+        exit(1);
+    }
+
+    rcu_startup();
+    rcu_setMinWait(1);
+
+    for (int j = 0; j < NSLOTS; j++)
+        replace(j, j);
+
+    nest(0);
+    outoforder();
+    promote();
+
+    pthread_t *tids = (pthread_t *)malloc((num_writers + num_readers) * sizeof(pthread_t));
+    run = true;
+    for (int j = 0; j < num_readers; j++)
+        pthread_create(&tids[j], NULL, reader, NULL);
+    for (int j = 0; j < num_writers; j++)
+        pthread_create(&tids[num_readers + j], NULL, writer, &count);
+    for (int j = 0; j < num_writers; j++)
+        pthread_join(tids[num_readers + j], NULL);
+    run = false;
+    for (int j = 0; j < num_readers; j++)
+        pthread_join(tids[j], NULL);
+    free(tids);
+
+    for (int j = 0; j < NSLOTS; j++)
+        slots[j] = (data_t *)nullptr;
+    smr_barrier();
+    atomic_ptr_hazards::release();
+
+    check(data_t::destroyed == data_t::created, "objects not reclaimed after guards dropped");
+    printf("created = %ld, destroyed = %ld, errors = %d\n", data_t::created, data_t::destroyed, errors);
+
+    rcu_shutdown();
+
+    return (errors == 0) ? 0 : 1;
+}
+
+/*-*/
@@ -0,0 +1,297 @@
+/*
+   Copyright 2013 Joseph W. Seigh
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+/*
+ * atomic_ptr_map vs. rwlock + std::unordered_map, mixed find/insert/erase
+ *
+ * g++ -std=c++11 -O2 -mcx16 -I../stdatomic -I../atomic-ptr \
+ *     maptest.cpp -o maptest -lpthread -latomic
+ *
+ * maptest -r 16 -s    runs 1 .. 16 threads, 95/5 read/write mix
+ *
+ * Every 16th op is timed for the latency percentiles.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include <sys/time.h>
+#include <pthread.h>
+#include <unordered_map>
+#include <algorithm>
+#include <memory>
+
+#include <atomic_ptr_map.h>
+
+#define SAMPLE_MASK 15          // time every 16th op
+
+//--------------------------------------------------------------------
+// maps under test, same interface
+//--------------------------------------------------------------------
+class rwlock_map {
+    public:
+        rwlock_map() { pthread_rwlock_init(&rwlock, NULL); }
+        ~rwlock_map() { pthread_rwlock_destroy(&rwlock); }
+
+        bool insert(long key, long value) {
+            pthread_rwlock_wrlock(&rwlock);
+            bool rc = map.insert(std::make_pair(key, value)).second;
+            pthread_rwlock_unlock(&rwlock);
+            return rc;
+        }
+
+        bool find(long key, long & value) {
+            bool rc = false;
+            pthread_rwlock_rdlock(&rwlock);
+            std::unordered_map<long, long>::iterator it = map.find(key);
+            if (it != map.end()) {
+                value = it->second;
+                rc = true;
+            }
+            pthread_rwlock_unlock(&rwlock);
+            return rc;
+        }
+
+        bool erase(long key) {
+            pthread_rwlock_wrlock(&rwlock);
+            bool rc = (map.erase(key) != 0);
+            pthread_rwlock_unlock(&rwlock);
+            return rc;
+        }
+
+    private:
+        pthread_rwlock_t                rwlock;
+        std::unordered_map<long, long>  map;
+};
+
+static atomic_ptr_map<long, long> amap;
+static rwlock_map rmap;
+
+typedef struct _testparm {
+    pthread_t   tid;
+    int         id;
+    long        count;          // ops
+    long        keys;           // key range
+    int         writepct;       // % inserts + erases
+
+    long        reads;
+    long        writes;
+    long        nsamples;
+    long        *samples;       // op latency, nsec
+} testparm;
+
+uint64_t gettimemillisec() {
+    struct timeval t;
+    gettimeofday(&t, NULL);
+    return (uint64_t)(t.tv_sec * 1000 + (t.tv_usec/1000));
+}
+
+static inline uint64_t gettimensec() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+//--------------------------------------------------------------------
+// random key ops, writes are half inserts and half erases so the
+// map stays about half full
+//--------------------------------------------------------------------
+template<typename M> void *testMix(M & map, testparm *parm) {
+    unsigned int seed = parm->id + 1;
+    long value;
+
+    for (long j = 0; j < parm->count; j++) {
+        long key = rand_r(&seed) % parm->keys;
+        int op = rand_r(&seed) % 200;
+        uint64_t t0 = ((j & SAMPLE_MASK) == 0) ? gettimensec() : 0;
+
+        if (op >= parm->writepct * 2) {
+            if (map.find(key, value) && value != key)
+                abort();
+            parm->reads++;
+        }
+        else {
+            if (op & 1)
+                map.insert(key, key);
+            else
+                map.erase(key);
+            parm->writes++;
+        }
+
+        if ((j & SAMPLE_MASK) == 0)
+            parm->samples[parm->nsamples++] = (long)(gettimensec() - t0);
+    }
+
+    return NULL;
+}
+
+void *testMixAtomic(void *arg) { return testMix(amap, (testparm *)arg); }
+void *testMixRwlock(void *arg) { return testMix(rmap, (testparm *)arg); }
+
+testparm *starttest(int num, void *(*test)(void *), long count, long keys, int writepct) {
+    testparm *parms = (testparm *)malloc(num * sizeof(testparm));
+    memset(parms, 0, num * sizeof(testparm));
+
+    for (int j = 0; j < num; j++) {
+        testparm *parm = &parms[j];
+        parm->id = j;
+        parm->count = count;
+        parm->keys = keys;
+        parm->writepct = writepct;
+        parm->samples = (long *)malloc((count / (SAMPLE_MASK + 1) + 1) * sizeof(long));
+        pthread_create(&parm->tid, NULL, test, parm);
+    }
+
+    return parms;
+}
+
+void endtest(int num, testparm *parms, testparm *result) {
+    result->samples = (long *)malloc((num * (parms[0].count / (SAMPLE_MASK + 1) + 1)) * sizeof(long));
+    for (int j = 0; j < num; j++) {
+        testparm *parm = &parms[j];
+        pthread_join(parm->tid, NULL);
+        result->reads += parm->reads;
+        result->writes += parm->writes;
+        memcpy(&result->samples[result->nsamples], parm->samples, parm->nsamples * sizeof(long));
+        result->nsamples += parm->nsamples;
+        free(parm->samples);
+    }
+    free(parms);
+}
+
+static long percentile(testparm *result, double pct) {
+    long ndx = (long)(pct / 100.0 * (double)(result->nsamples - 1));
+    return result->samples[ndx];
+}
+
+
+const char* testdesc[] = {
+    "atomic_ptr_map",
+    "rwlock + std::unordered_map",
+};
+void *(*mixTest[])(void *) = {
+    testMixAtomic,
+    testMixRwlock,
+};
+int max_test_number = sizeof(testdesc)/sizeof(char*);
+
+void runtest(int test_num, long count, int num_threads, long keys, int writepct) {
+    testparm result;
+    memset(&result, 0, sizeof(result));
+
+    printf("count=%ld, threads=%d, keys=%ld, writes=%d%%\n", count, num_threads, keys, writepct);
+
+    uint64_t t0 = gettimemillisec();
+    testparm *parms = starttest(num_threads, mixTest[test_num], count, keys, writepct);
+    endtest(num_threads, parms, &result);
+    uint64_t t1 = gettimemillisec();
+
+    long elapsed = (t1 > t0) ? (long)(t1 - t0) : 1;
+    long ops = result.reads + result.writes;
+
+    printf("ops = %ld, elapsed time = %ld msec, ops/msec = %6.4f, ops/msec/thread = %6.4f\n",
+            ops, elapsed, (double)ops/(double)elapsed, (double)ops/(double)elapsed/(double)num_threads);
+    if (result.nsamples > 0) {
+        std::sort(result.samples, result.samples + result.nsamples);
+        printf("latency nsec: p50 = %ld, p90 = %ld, p99 = %ld, p99.9 = %ld, max = %ld\n",
+                percentile(&result, 50.0), percentile(&result, 90.0), percentile(&result, 99.0),
+                percentile(&result, 99.9), result.samples[result.nsamples - 1]);
+    }
+    free(result.samples);
+}
+
+
+int main(int argc, char **argv) {
+    int     n;
+    int     help = 0;
+
+    long    count = 1000000;    // default ops per thread
+    int     num_threads = 1;
+    long    keys = 100000;
+    int     writepct = 5;
+    int     test_num = 0;
+    int     sweep = 0;          // run w/ 1 .. num_threads threads
+
+    while ((n = getopt(argc, argv, "t:n:hr:k:w:s")) > -1) {
+        switch ((char)n) {
+            case 't':
+                test_num = atoi(optarg);
+                break;
+
+            case 'n':
+                count = atol(optarg);
+                break;
+
+            case 'r':
+                num_threads = atoi(optarg);
+                break;
+
+            case 'k':
+                keys = atol(optarg);
+                break;
+
+            case 'w':
+                writepct = atoi(optarg);
+                break;
+
+            case 's':
+                sweep = 1;
+                break;
+
+            case 'h':
+            case '?':
+            default:
+                help = 1;
+                break;
+        }
+    }
+
+    if (help || test_num < 0 || test_num >= max_test_number || num_threads < 1 || keys < 1 || writepct < 0 || writepct > 100) {
+        fprintf(stderr, "usage %s <options>\n", argv[0]);
+        fprintf(stderr, "where options are:\n");
+        fprintf(stderr, "\t-n : number of ops per thread\n");
+        fprintf(stderr, "\t-r : number of threads\n");
+        fprintf(stderr, "\t-k : key range, map is prefilled w/ every other key\n");
+        fprintf(stderr, "\t-w : percent writes, default 5\n");
+        fprintf(stderr, "\t-s : scaling, repeat w/ 1 to -r threads\n");
+        fprintf(stderr, "\t-t : testcase # default 0\n");
+        for (int j = 0; j < max_test_number; j++) {
+            fprintf(stderr, "\t\ttestcase %d: %s\n", j, testdesc[j]);
+        }
+        exit(1);
+    }
+
+    printf("testcase %d: %s\n", test_num, testdesc[test_num]);
+
+    for (long key = 0; key < keys; key += 2) {
+        amap.insert(key, key);
+        rmap.insert(key, key);
+    }
+
+    if (sweep) {
+        for (int j = 1; j <= num_threads; j++)
+            runtest(test_num, count, j, keys, writepct);
+    }
+    else
+        runtest(test_num, count, num_threads, keys, writepct);
+
+    return 0;
+}
+
+/*-*/
@@ -0,0 +1,305 @@
+/*
+   Copyright 2013 Joseph W. Seigh
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+/*
+ * atomic_ptr_queue throughput vs. mutex + std::deque
+ *
+ * g++ -std=c++11 -O2 -mcx16 -I../stdatomic -I../atomic-ptr \
+ *     queuetest.cpp -o queuetest -lpthread -latomic
+ *
+ * queuetest -p 32 -c 32 -s    runs 1/1 .. 32/32 producers/consumers
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include <sys/time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <deque>
+#include <memory>
+
+#include <atomic_ptr_queue.h>
+
+typedef struct _item_t {
+    int     producer;
+    long    seq;
+} item_t;
+
+//--------------------------------------------------------------------
+// queues under test, same try_dequeue interface
+//--------------------------------------------------------------------
+class mutex_queue {
+    public:
+        mutex_queue() { pthread_mutex_init(&mutex, NULL); }
+        ~mutex_queue() { pthread_mutex_destroy(&mutex); }
+
+        bool enqueue(const item_t & item) {
+            pthread_mutex_lock(&mutex);
+            queue.push_back(item);
+            pthread_mutex_unlock(&mutex);
+            return true;
+        }
+
+        bool try_dequeue(item_t & item) {
+            bool rc = false;
+            pthread_mutex_lock(&mutex);
+            if (!queue.empty()) {
+                item = queue.front();
+                queue.pop_front();
+                rc = true;
+            }
+            pthread_mutex_unlock(&mutex);
+            return rc;
+        }
+
+    private:
+        pthread_mutex_t     mutex;
+        std::deque<item_t>  queue;
+};
+
+static atomic_ptr_queue<item_t> *aqueue;
+static atomic_ptr_queue<item_t> *bqueue;    // bounded
+static mutex_queue *mqueue;
+
+static volatile long consumed;              // total dequeued
+static volatile bool failed = false;        // fifo order violated
+
+typedef struct _testparm {
+    pthread_t   tid;
+    int         id;
+    long        count;              // items per producer, total for consumers
+    int         num_producers;
+
+    long        ops;                // enqueues or dequeues
+    long        retries;            // full or empty
+} testparm;
+
+uint64_t gettimemillisec() {
+    struct timeval t;
+    gettimeofday(&t, NULL);
+    return (uint64_t)(t.tv_sec * 1000 + (t.tv_usec/1000));
+}
+
+//--------------------------------------------------------------------
+// producer -- enqueue count items, retry while full
+//--------------------------------------------------------------------
+template<typename Q> void *testProduce(Q *queue, testparm *parm) {
+    item_t item;
+    item.producer = parm->id;
+
+    for (long j = 0; j < parm->count; j++) {
+        item.seq = j;
+        while (!queue->enqueue(item)) {
+            parm->retries++;
+            sched_yield();
+        }
+        parm->ops++;
+    }
+
+    return NULL;
+}
+
+//--------------------------------------------------------------------
+// consumer -- dequeue until all produced items are consumed.  Items
+// from each producer must be seen in order.
+//--------------------------------------------------------------------
+template<typename Q> void *testConsume(Q *queue, testparm *parm) {
+    long *last = (long *)malloc(parm->num_producers * sizeof(long));
+    for (int j = 0; j < parm->num_producers; j++)
+        last[j] = -1;
+
+    item_t item;
+    while (atomic_load_explicit(&consumed, memory_order_relaxed) < parm->count) {
+        if (queue->try_dequeue(item)) {
+            if (item.seq <= last[item.producer])
+                failed = true;
+            last[item.producer] = item.seq;
+            atomic_fetch_add_explicit(&consumed, 1L, memory_order_relaxed);
+            parm->ops++;
+        }
+        else {
+            parm->retries++;
+            sched_yield();
+        }
+    }
+
+    free(last);
+    return NULL;
+}
+
+void *testProduceAtomic(void *arg) { return testProduce(aqueue, (testparm *)arg); }
+void *testConsumeAtomic(void *arg) { return testConsume(aqueue, (testparm *)arg); }
+void *testProduceBounded(void *arg) { return testProduce(bqueue, (testparm *)arg); }
+void *testConsumeBounded(void *arg) { return testConsume(bqueue, (testparm *)arg); }
+void *testProduceMutex(void *arg) { return testProduce(mqueue, (testparm *)arg); }
+void *testConsumeMutex(void *arg) { return testConsume(mqueue, (testparm *)arg); }
+
+testparm *starttest(int num, void *(*test)(void *), long count, int num_producers) {
+    testparm *parms = (testparm *)malloc(num * sizeof(testparm));
+    memset(parms, 0, num * sizeof(testparm));
+
+    for (int j = 0; j < num; j++) {
+        testparm *parm = &parms[j];
+        parm->id = j;
+        parm->count = count;
+        parm->num_producers = num_producers;
+        pthread_create(&parm->tid, NULL, test, parm);
+    }
+
+    return parms;
+}
+
+void endtest(int num, testparm *parms, testparm *result) {
+    for (int j = 0; j < num; j++) {
+        testparm *parm = &parms[j];
+        pthread_join(parm->tid, NULL);
+        result->ops += parm->ops;
+        result->retries += parm->retries;
+    }
+    free(parms);
+}
+
+
+const char* testdesc[] = {
+    "atomic_ptr_queue",
+    "atomic_ptr_queue, bounded (-b)",
+    "mutex + std::deque",
+};
+void *(*produceTest[])(void *) = {
+    testProduceAtomic,
+    testProduceBounded,
+    testProduceMutex,
+};
+void *(*consumeTest[])(void *) = {
+    testConsumeAtomic,
+    testConsumeBounded,
+    testConsumeMutex,
+};
+int max_test_number = sizeof(testdesc)/sizeof(char*);
+
+void runtest(int test_num, long count, int num_producers, int num_consumers) {
+    testparm presult, cresult;
+    memset(&presult, 0, sizeof(presult));
+    memset(&cresult, 0, sizeof(cresult));
+
+    printf("count=%ld, producers=%d, consumers=%d\n", count, num_producers, num_consumers);
+
+    consumed = 0;
+    uint64_t t0 = gettimemillisec();
+    testparm *cparms = starttest(num_consumers, consumeTest[test_num], count * num_producers, num_producers);
+    testparm *pparms = starttest(num_producers, produceTest[test_num], count, num_producers);
+    endtest(num_producers, pparms, &presult);
+    endtest(num_consumers, cparms, &cresult);
+    uint64_t t1 = gettimemillisec();
+
+    long elapsed = (t1 > t0) ? (long)(t1 - t0) : 1;
+
+    printf("items = %ld, elapsed time = %ld msec, items/msec = %6.4f\n",
+            cresult.ops, elapsed, (double)cresult.ops/(double)elapsed);
+    printf("full retries = %ld, empty retries = %ld\n", presult.retries, cresult.retries);
+    if (failed || cresult.ops != presult.ops) {
+        printf("error: items out of order or lost\n");
+        exit(1);
+    }
+}
+
+
+int main(int argc, char **argv) {
+    int     n;
+    int     help = 0;
+
+    long    count = 1000000;    // default items per producer
+    int     num_producers = 1;
+    int     num_consumers = 1;
+    long    capacity = 1024;    // bounded testcase
+    int     test_num = 0;
+    int     sweep = 0;          // run w/ 1/1 .. producers/consumers
+
+    while ((n = getopt(argc, argv, "t:n:hp:c:b:s")) > -1) {
+        switch ((char)n) {
+            case 't':
+                test_num = atoi(optarg);
+                break;
+
+            case 'n':
+                count = atol(optarg);
+                break;
+
+            case 'p':
+                num_producers = atoi(optarg);
+                break;
+
+            case 'c':
+                num_consumers = atoi(optarg);
+                break;
+
+            case 'b':
+                capacity = atol(optarg);
+                break;
+
+            case 's':
+                sweep = 1;
+                break;
+
+            case 'h':
+            case '?':
+            default:
+                help = 1;
+                break;
+        }
+    }
+
+    if (help || test_num < 0 || test_num >= max_test_number || num_producers < 1 || num_consumers < 1 || capacity < 1) {
+        fprintf(stderr, "usage %s <options>\n", argv[0]);
+        fprintf(stderr, "where options are:\n");
+        fprintf(stderr, "\t-n : number of items per producer\n");
+        fprintf(stderr, "\t-p : number of producer threads\n");
+        fprintf(stderr, "\t-c : number of consumer threads\n");
+        fprintf(stderr, "\t-b : capacity of bounded queue, default 1024\n");
+        fprintf(stderr, "\t-s : scaling, repeat w/ 1 to -p producers and 1 to -c consumers\n");
+        fprintf(stderr, "\t-t : testcase # default 0\n");
+        for (int j = 0; j < max_test_number; j++) {
+            fprintf(stderr, "\t\ttestcase %d: %s\n", j, testdesc[j]);
+        }
+        exit(1);
+    }
+
+    printf("testcase %d: %s\n", test_num, testdesc[test_num]);
+
+    atomic_ptr_queue<item_t> unbounded;
+    atomic_ptr_queue<item_t> bounded(capacity);
+    mutex_queue locked;
+    aqueue = &unbounded;
+    bqueue = &bounded;
+    mqueue = &locked;
+
+    if (sweep) {
+        int max = (num_producers > num_consumers) ? num_producers : num_consumers;
+        for (int j = 1; j <= max; j++)
+            runtest(test_num, count,
+                    (j < num_producers) ? j : num_producers,
+                    (j < num_consumers) ? j : num_consumers);
+    }
+    else
+        runtest(test_num, count, num_producers, num_consumers);
+
+    return 0;
+}
+
+/*-*/
@@ -0,0 +1,207 @@
+/*
+Copyright 2006 Joseph W. Seigh
+
+Permission to use, copy, modify and distribute this software
+and its documentation for any purpose and without fee is
+hereby granted, provided that the above copyright notice
+appear in all copies, that both the copyright notice and this
+permission notice appear in supporting documentation.  I make
+no representations about the suitability of this software for
+any purpose. It is provided "as is" without express or implied
+warranty.
+
+---
+*/
+
+/*
+ * smr_defer throughput vs. number of writer threads.  Writers push
+ * deferred work onto a retire list in their smr node.  Pure writers
+ * (-l) never call smr_acquire, their first defer makes the node, so
+ * they shouldn't take rcu_mutex either (lockdefers 0).  Then a thread
+ * that stays alive defers a few items and waits for them to be freed
+ * w/o flushing.
+ *
+ * link w/ fastsmr.c rcuscan.c smrscan.c fifo.c qcount.c
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include <pthread.h>
+
+#include <fastsmr.h>
+#include <rcustats.h>
+#include <utime.h>
+#include <smrtest.h>
+
+
+typedef struct item_tt {
+	rcu_defer_t		defer;
+	long			val;
+} item_t;
+
+typedef struct parm_tt {
+	pthread_t		tid;
+	long			count;			// defers
+	int				buffered;		// smr_acquire before deferring
+} parm_t;
+
+static long		freed = 0;		// items freed by polling thread
+
+
+//------------------------------------------------------------------------------
+// item_free -- defer function
+//------------------------------------------------------------------------------
+void item_free(void *arg) {
+	free(arg);
+	smrtest_count(&freed);
+}
+
+
+//------------------------------------------------------------------------------
+// writer -- defer count items
+//------------------------------------------------------------------------------
+void *writer(void *arg) {
+	parm_t	*parm = (parm_t *)arg;
+	item_t	*item;
+	long	j;
+
+	if (parm->buffered && smr_acquire() == NULL)
+		abort();
+
+	for (j = 0; j < parm->count; j++) {
+		item = (item_t *)malloc(sizeof(item_t));
+		item->val = j;
+		smrtest_init(&item->defer, &item_free, item);
+		smr_defer(&item->defer);
+	}
+
+	return NULL;
+}
+
+
+//------------------------------------------------------------------------------
+// straggler -- defer a few items and wait for them w/o exiting
+//
+//   arg is the total deferred by all threads including these
+//------------------------------------------------------------------------------
+void *straggler(void *arg) {
+	parm_t	parm = {0, 5, 1};
+	long	total = *(long *)arg;
+
+	writer(&parm);
+
+	return smrtest_waitfor(&freed, total, 2000) ? NULL : (void *)1;
+}
+
+
+//------------------------------------------------------------------------------
+// defertest -- defers per msec
+//------------------------------------------------------------------------------
+double defertest(int nthreads, long count, int buffered) {
+	parm_t		*parms;
+	utime_t		t0, t1;
+	int			j;
+
+	parms = (parm_t *)calloc(nthreads, sizeof(parm_t));
+
+	t0 = getutimeofday();
+	for (j = 0; j < nthreads; j++) {
+		parms[j].count = count;
+		parms[j].buffered = buffered;
+		pthread_create(&parms[j].tid, NULL, &writer, &parms[j]);
+	}
+	for (j = 0; j < nthreads; j++)
+		pthread_join(parms[j].tid, NULL);
+	t1 = getutimeofday();
+
+	free(parms);
+
+	if (t1 <= t0)
+		t1 = t0 + 1;
+	return (double)(nthreads * count) * 1000.0 / (double)(t1 - t0);
+}
+
+
+//--------------------------------------------------------------------
+// main --
+//
+//--------------------------------------------------------------------
+int main(int argc, char *argv[]) {
+	int		nthreads = 8;
+	long	count = 100000;
+	int		pure = 0;
+	int		sweep = 0;
+	int		_h = 0;
+	int		n, t;
+	long	total = 0;
+	pthread_t	tid;
+	void	*stuck;
+	rcu_stats_t	rstats;
+
+	while ((n = getopt(argc, argv, "hr:n:ls")) > -1) {
+		switch ((char)n) {
+			case 'r':
+				nthreads = atoi(optarg);
+				break;
+
+			case 'n':
+				count = atol(optarg);
+				break;
+
+			case 'l':
+				pure = 1;
+				break;
+
+			case 's':
+				sweep = 1;
+				break;
+
+			case 'h':
+			default:
+				_h = 1;
+				break;
+		}
+	}
+
+	if (_h || nthreads < 1 || count < 1) {
+		fprintf(stderr, "usage: %s -<opts>\n", argv[0]);
+		fprintf(stderr, "\n");
+		fprintf(stderr, "where opts =\n");
+		fprintf(stderr, "\t-r  :  number of writer threads, default 8\n");
+		fprintf(stderr, "\t-n  :  number of defers per thread, default 100000\n");
+		fprintf(stderr, "\t-l  :  writers don't smr_acquire, node made by first defer\n");
+		fprintf(stderr, "\t-s  :  sweep threads 1, 2, 4 .. -r\n");
+		fprintf(stderr, "\t-h  :  print this help message\n");
+		exit(1);
+	}
+
+	rcu_startup();
+
+	printf("%s\n", pure ? "pure writers, no smr_acquire" : "retire lists");
+	printf("%8s %12s\n", "threads", "defers/msec");
+	for (t = sweep ? 1 : nthreads; t <= nthreads; t = (t < nthreads && t * 2 > nthreads) ? nthreads : t * 2) {
+		printf("%8d %12.1f\n", t, defertest(t, count, !pure));
+		total += t * count;
+	}
+
+	total += 5;
+	pthread_create(&tid, NULL, &straggler, &total);
+	pthread_join(tid, &stuck);
+
+	rcu_shutdown();
+
+	copyStats(&rstats);
+	printf("freed = %ld of %ld, defers = %d, defersigs = %d, lockdefers = %d\n", freed, total,
+		rstats.defers, rstats.defersigs, rstats.lockdefers);
+	if (stuck != NULL)
+		printf("error: straggler's items not freed while it was alive\n");
+	if (rstats.lockdefers != 0)
+		printf("error: defers took rcu_mutex\n");
+
+	return (freed == total && stuck == NULL && rstats.lockdefers == 0) ? 0 : 1;
+}
+
+
+/*-*/
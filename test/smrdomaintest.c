@@ -0,0 +1,254 @@
+/*
+Copyright 2006 Joseph W. Seigh
+
+Permission to use, copy, modify and distribute this software
+and its documentation for any purpose and without fee is
+hereby granted, provided that the above copyright notice
+appear in all copies, that both the copyright notice and this
+permission notice appear in supporting documentation.  I make
+no representations about the suitability of this software for
+any purpose. It is provided "as is" without express or implied
+warranty.
+
+---
+*/
+
+/*
+ * reclamation latency of a steady writer while a bursty writer floods
+ * its domain w/ slow deferred frees, w/ each in its own smr domain or
+ * both in the default domain (-1).  -l and -m set adaptive polling
+ * targets on both domains instead of the fixed -w interval.
+ *
+ * link w/ fastsmr.c rcuscan.c smrscan.c fifo.c qcount.c
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <time.h>
+
+#include <fastsmr.h>
+#include <rcustats.h>
+#include <utime.h>
+#include <smrtest.h>
+
+
+typedef struct item_tt {
+	rcu_defer_t		defer;
+	utime_t			stamp;			// time deferred
+} item_t;
+
+static smr_domain_t	*steady;		// steady writer's domain
+static smr_domain_t	*bursty;		// bursty writer's domain
+
+static int		nsteady = 2000;		// steady defers
+static int		interval = 500;		// usecs between steady defers
+static int		burst = 2000;		// defers per burst
+static int		cost = 200;			// usecs per bursty free
+static int		minwait = 1;		// fixed poll interval, msecs
+static int		target = 0;			// target grace period latency, msecs
+static int		backlog = 0;		// target max backlog
+
+static utime_t	*latency;			// steady reclamation latency, usecs
+static int		nlatency = 0;
+static int		done = 0;
+
+
+//------------------------------------------------------------------------------
+// steady_free -- record reclamation latency, steady domain's polling thread
+//------------------------------------------------------------------------------
+void steady_free(void *arg) {
+	item_t	*item = (item_t *)arg;
+
+	latency[nlatency++] = getutimeofday() - item->stamp;
+	free(item);
+}
+
+//------------------------------------------------------------------------------
+// bursty_free -- slow free, burn cost usecs
+//------------------------------------------------------------------------------
+void bursty_free(void *arg) {
+	smrtest_spin(cost);
+	free(arg);
+}
+
+//------------------------------------------------------------------------------
+// newitem -- item stamped w/ time deferred
+//------------------------------------------------------------------------------
+static item_t *newitem(void (*func)(void *)) {
+	item_t	*item = (item_t *)malloc(sizeof(item_t));
+
+	smrtest_init(&item->defer, func, item);
+	item->stamp = getutimeofday();
+	return item;
+}
+
+
+//------------------------------------------------------------------------------
+// steadywriter -- defer an item every interval usecs
+//------------------------------------------------------------------------------
+void *steadywriter(void *arg) {
+	struct timespec	ts = {0, interval * 1000};
+	int		j;
+
+	smr_domain_acquire(steady);
+	for (j = 0; j < nsteady; j++) {
+		smr_domain_defer(steady, &newitem(&steady_free)->defer);
+		nanosleep(&ts, NULL);
+	}
+	smr_domain_release(steady);
+
+	atomic_store(&done, 1);
+	return NULL;
+}
+
+//------------------------------------------------------------------------------
+// burstywriter -- defer a burst of slow items every 100 msecs
+//------------------------------------------------------------------------------
+void *burstywriter(void *arg) {
+	struct timespec	ts = {0, 100000000};
+	int		j;
+
+	smr_domain_acquire(bursty);
+	while (!atomic_load(&done)) {
+		for (j = 0; j < burst; j++)
+			smr_domain_defer(bursty, &newitem(&bursty_free)->defer);
+		nanosleep(&ts, NULL);
+	}
+	smr_domain_release(bursty);
+
+	return NULL;
+}
+
+
+static void printstats(const char *name, smr_domain_t *d, utime_t elapsed) {
+	rcu_stats_t	st;
+
+	smr_domain_copyStats(d, &st);
+	printf("%s: qwaits = %d, wait = %llu, gplast = %llu, gpmax = %llu, shortens = %d, lengthens = %d, backlogged = %d\n",
+		name, st.qwaits, st.wait, st.gplast, st.gpmax, st.shortens, st.lengthens, st.backlogged);
+	printf("%s: qsets = %d (%.0f/sec), qskips = %d\n",
+		name, st.qsets, (double)st.qsets * 1000000.0 / (double)elapsed, st.qskips);
+}
+
+
+static int utimecmp(const void *a, const void *b) {
+	utime_t x = *(const utime_t *)a;
+	utime_t y = *(const utime_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+
+//--------------------------------------------------------------------
+// main --
+//
+//--------------------------------------------------------------------
+int main(int argc, char *argv[]) {
+	pthread_t	tid[2];
+	utime_t		t0, elapsed;
+	int			shared = 0;
+	int			_h = 0;
+	int			n;
+
+	while ((n = getopt(argc, argv, "h1n:i:b:c:w:l:m:")) > -1) {
+		switch ((char)n) {
+			case '1':
+				shared = 1;
+				break;
+
+			case 'n':
+				nsteady = atoi(optarg);
+				break;
+
+			case 'i':
+				interval = atoi(optarg);
+				break;
+
+			case 'b':
+				burst = atoi(optarg);
+				break;
+
+			case 'c':
+				cost = atoi(optarg);
+				break;
+
+			case 'w':
+				minwait = atoi(optarg);
+				break;
+
+			case 'l':
+				target = atoi(optarg);
+				break;
+
+			case 'm':
+				backlog = atoi(optarg);
+				break;
+
+			case 'h':
+			default:
+				_h = 1;
+				break;
+		}
+	}
+
+	if (_h || nsteady < 1 || interval < 0 || interval >= 1000000 || burst < 0 || cost < 0 || minwait < 1 || target < 0 || backlog < 0) {
+		fprintf(stderr, "usage: %s -<opts>\n", argv[0]);
+		fprintf(stderr, "\n");
+		fprintf(stderr, "where opts =\n");
+		fprintf(stderr, "\t-1  :  both writers in the default domain\n");
+		fprintf(stderr, "\t-n  :  number of steady defers, default 2000\n");
+		fprintf(stderr, "\t-i  :  usecs between steady defers, default 500\n");
+		fprintf(stderr, "\t-b  :  defers per burst, default 2000\n");
+		fprintf(stderr, "\t-c  :  usecs per bursty free, default 200\n");
+		fprintf(stderr, "\t-w  :  fixed poll interval msecs, default 1\n");
+		fprintf(stderr, "\t-l  :  target grace period latency msecs, adaptive polling\n");
+		fprintf(stderr, "\t-m  :  target max backlog w/ -l\n");
+		fprintf(stderr, "\t-h  :  print this help message\n");
+		exit(1);
+	}
+
+	latency = (utime_t *)calloc(nsteady, sizeof(utime_t));
+
+	rcu_startup();
+	if (shared) {
+		steady = smr_domain_default();
+		bursty = smr_domain_default();
+	}
+	else {
+		steady = smr_domain_create();
+		bursty = smr_domain_default();
+	}
+	smr_domain_setMinWait(steady, minwait);
+	smr_domain_setMinWait(bursty, minwait);
+	if (target > 0) {
+		smr_domain_setTargets(steady, backlog, target);
+		smr_domain_setTargets(bursty, backlog, target);
+	}
+
+	t0 = getutimeofday();
+	pthread_create(&tid[0], NULL, &steadywriter, NULL);
+	pthread_create(&tid[1], NULL, &burstywriter, NULL);
+	pthread_join(tid[0], NULL);
+	pthread_join(tid[1], NULL);
+	elapsed = getutimeofday() - t0 + 1;
+
+	if (!shared) {
+		printstats("steady", steady, elapsed);
+		smr_domain_destroy(steady);
+	}
+	printstats(shared ? "shared" : "bursty", bursty, elapsed);
+	rcu_shutdown();
+
+	printf("%s, burst = %d x %d usec\n", shared ? "shared domain" : "separate domains", burst, cost);
+	qsort(latency, nlatency, sizeof(utime_t), &utimecmp);
+	printf("steady reclamation latency usec: p50 = %llu, p99 = %llu, max = %llu (%d of %d)\n",
+		latency[nlatency / 2], latency[(nlatency * 99) / 100], latency[nlatency - 1], nlatency, nsteady);
+
+	return (nlatency == nsteady) ? 0 : 1;
+}
+
+
+/*-*/
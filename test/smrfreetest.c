@@ -0,0 +1,256 @@
+/*
+Copyright 2006 Joseph W. Seigh
+
+Permission to use, copy, modify and distribute this software
+and its documentation for any purpose and without fee is
+hereby granted, provided that the above copyright notice
+appear in all copies, that both the copyright notice and this
+permission notice appear in supporting documentation.  I make
+no representations about the suitability of this software for
+any purpose. It is provided "as is" without express or implied
+warranty.
+
+---
+*/
+
+/*
+ * smr_defer_free_sized vs. smr_defer w/ an rcu_defer_t embedded in each
+ * object (-e).  Writers swap new objects into shared slots and defer
+ * freeing the old ones while readers traverse the slots under hazard
+ * pointers, aborting on a reclaimed object.  Run w/ a memory checker
+ * to catch early frees that still look valid.  -u writers don't call
+ * smr_acquire, their first free makes their smr node.
+ *
+ * link w/ fastsmr.c rcuscan.c smrscan.c fifo.c qcount.c
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include <pthread.h>
+
+#include <fastsmr.h>
+#include <rcustats.h>
+#include <utime.h>
+#include <smrtest.h>
+
+
+#define MAGIC	0x5eed5eedL
+#define NSLOTS	64
+
+typedef struct obj_tt {
+	long			magic;
+	long			val;
+} obj_t;
+
+typedef struct eobj_tt {			// -e, w/ embedded deferred work
+	obj_t			obj;
+	rcu_defer_t		defer;
+} eobj_t;
+
+static obj_t	*slot[NSLOTS];
+static int		embedded = 0;
+static long		count = 100000;		// defers per writer
+static int		writers = 0;
+static long		reads = 0;
+
+
+//------------------------------------------------------------------------------
+// eobj_free -- defer function, -e
+//------------------------------------------------------------------------------
+void eobj_free(void *arg) {
+	((obj_t *)arg)->magic = 0;
+	free(arg);
+}
+
+//------------------------------------------------------------------------------
+// newobj -- object w/ magic set, w/ embedded rcu_defer_t if -e
+//------------------------------------------------------------------------------
+static obj_t *newobj(long val) {
+	obj_t	*obj;
+	eobj_t	*eobj;
+
+	if (embedded) {
+		eobj = (eobj_t *)malloc(sizeof(eobj_t));
+		smrtest_init(&eobj->defer, &eobj_free, eobj);
+		obj = &eobj->obj;
+	}
+	else
+		obj = (obj_t *)malloc(sizeof(obj_t));
+
+	obj->magic = MAGIC;
+	obj->val = val;
+	return obj;
+}
+
+
+//------------------------------------------------------------------------------
+// writer -- swap new objects into slots, defer freeing old ones
+//
+//   arg is non null for a writer that doesn't smr_acquire, its first
+//   free makes its smr node
+//------------------------------------------------------------------------------
+void *writer(void *arg) {
+	obj_t	*old;
+	long	j;
+
+	if (arg == NULL && smr_acquire() == NULL)
+		abort();
+
+	for (j = 0; j < count; j++) {
+		old = __atomic_exchange_n(&slot[j % NSLOTS], newobj(j), __ATOMIC_ACQ_REL);
+
+		if (embedded)
+			smr_defer(&((eobj_t *)old)->defer);
+		else
+			smr_defer_free_sized(old, sizeof(obj_t));
+	}
+
+	__sync_fetch_and_sub(&writers, 1);
+	return NULL;		// partial page handed off on exit
+}
+
+
+//------------------------------------------------------------------------------
+// reader -- traverse slots under hazard pointer until writers are done
+//------------------------------------------------------------------------------
+void *reader(void *arg) {
+	smr_t	*local;
+	obj_t	*obj;
+	long	n = 0;
+	int		j;
+
+	if ((local = smr_acquire()) == NULL)
+		abort();
+
+	while (atomic_load(&writers) > 0) {
+		for (j = 0; j < NSLOTS; j++) {
+			obj = smrload(local, &slot[j]);
+			if (obj->magic != MAGIC)		// reclaimed
+				abort();
+			n++;
+		}
+		smrnull(local);
+	}
+
+	__sync_fetch_and_add(&reads, n);
+	return NULL;
+}
+
+
+//--------------------------------------------------------------------
+// main --
+//
+//--------------------------------------------------------------------
+int main(int argc, char *argv[]) {
+	pthread_t	*tids;
+	int		nwriters = 2;
+	int		nreaders = 2;
+	int		nshared = 1;		// writers w/o smr_acquire
+	long	expected;
+	int		_h = 0;
+	int		n, j;
+	utime_t	t0, t1;
+	rcu_stats_t	rstats;
+
+	while ((n = getopt(argc, argv, "hr:R:u:n:e")) > -1) {
+		switch ((char)n) {
+			case 'r':
+				nwriters = atoi(optarg);
+				break;
+
+			case 'R':
+				nreaders = atoi(optarg);
+				break;
+
+			case 'u':
+				nshared = atoi(optarg);
+				break;
+
+			case 'n':
+				count = atol(optarg);
+				break;
+
+			case 'e':
+				embedded = 1;
+				break;
+
+			case 'h':
+			default:
+				_h = 1;
+				break;
+		}
+	}
+
+	if (_h || nwriters < 0 || nreaders < 0 || nshared < 0 || nwriters + nshared < 1 || count < 1) {
+		fprintf(stderr, "usage: %s -<opts>\n", argv[0]);
+		fprintf(stderr, "\n");
+		fprintf(stderr, "where opts =\n");
+		fprintf(stderr, "\t-r  :  number of writer threads, default 2\n");
+		fprintf(stderr, "\t-R  :  number of reader threads, default 2\n");
+		fprintf(stderr, "\t-u  :  number of writer threads w/o smr_acquire, default 1\n");
+		fprintf(stderr, "\t-n  :  number of defers per writer, default 100000\n");
+		fprintf(stderr, "\t-e  :  smr_defer w/ embedded rcu_defer_t\n");
+		fprintf(stderr, "\t-h  :  print this help message\n");
+		exit(1);
+	}
+
+	if (embedded)
+		nshared = 0;				// smr_defer w/o node takes rcu_mutex, not a page
+
+	tids = (pthread_t *)calloc(nwriters + nshared + nreaders, sizeof(pthread_t));
+
+	rcu_startup();
+	rcu_setMinWait(1);
+
+	for (j = 0; j < NSLOTS; j++)
+		slot[j] = newobj(-1);
+
+	writers = nwriters + nshared;
+	t0 = getutimeofday();
+	for (j = 0; j < nwriters + nshared + nreaders; j++) {
+		if (j < nwriters + nshared)
+			pthread_create(&tids[j], NULL, &writer, (j < nwriters) ? NULL : (void *)1);
+		else
+			pthread_create(&tids[j], NULL, &reader, NULL);
+	}
+	for (j = 0; j < nwriters + nshared + nreaders; j++)
+		pthread_join(tids[j], NULL);
+
+	// main thread's first free makes its smr node
+	for (j = 0; j < NSLOTS; j++) {
+		if (embedded)
+			free((void *)slot[j]);			// obj first in eobj_t
+		else
+			smr_defer_free((void *)slot[j]);
+	}
+
+	smr_barrier();
+	t1 = getutimeofday();
+
+	copyStats(&rstats);
+	rcu_shutdown();
+
+	if (t1 <= t0)
+		t1 = t0 + 1;
+	printf("%s, object size = %d\n", embedded ? "smr_defer" : "smr_defer_free_sized",
+		(int)(embedded ? sizeof(eobj_t) : sizeof(obj_t)));
+	printf("defers/msec = %.1f, reads = %ld\n", (double)((nwriters + nshared) * count) * 1000.0 / (double)(t1 - t0), reads);
+	printf("defers = %d, undefers = %d, frees = %d, freepages = %d, freebytes = %lld\n",
+		rstats.defers, rstats.undefers, rstats.frees, rstats.freepages, rstats.freebytes);
+
+	free(tids);
+
+	// every pointer deferred was freed by smr_barrier
+	expected = embedded ? 0 : (nwriters + nshared) * count + NSLOTS;
+	if (rstats.frees != expected || rstats.undefers != rstats.defers) {
+		printf("error: frees = %d, expected %ld\n", rstats.frees, expected);
+		return 1;
+	}
+
+	return 0;
+}
+
+
+/*-*/
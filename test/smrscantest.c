@@ -0,0 +1,237 @@
+/*
+Copyright 2006 Joseph W. Seigh
+
+Permission to use, copy, modify and distribute this software
+and its documentation for any purpose and without fee is
+hereby granted, provided that the above copyright notice
+appear in all copies, that both the copyright notice and this
+permission notice appear in supporting documentation.  I make
+no representations about the suitability of this software for
+any purpose. It is provided "as is" without express or implied
+warranty.
+
+---
+*/
+
+/*
+ * smr_scan cost vs. number of threads (hazard pointers) and backlog
+ * of deferred work.  Each point queues a backlog of trace defers, a
+ * fraction of them held by hazard pointers, and times smr_scan w/
+ * rcu_mutex held the same as the polling thread.  Every item held by a
+ * hazard pointer, in any of a thread's blocks (-p > 8), has to stay
+ * queued after the scan.
+ *
+ * link w/ fastsmr.c rcuscan.c smrscan.c fifo.c qcount.c
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <time.h>
+
+#include <fastsmr.h>
+#include <userrcu.h>
+#include <atomix.h>
+#include <utime.h>
+#include <smrtest.h>
+
+
+typedef struct item_tt {
+	rcu_defer_t		defer;
+	long			val;
+} item_t;
+
+typedef struct parm_tt {
+	pthread_t		tid;
+	int				npairs;			// hazard pointer pairs
+	smr_t			**hptr;			// thread's hazard pointer pairs
+} parm_t;
+
+static pthread_barrier_t	ready;		// threads registered
+static pthread_barrier_t	done;		// scans finished
+static long					freed = 0;	// items freed by polling thread
+static long					released = 0;	// held items not requeued by smr_scan
+
+
+//------------------------------------------------------------------------------
+// item_free -- defer function
+//------------------------------------------------------------------------------
+void item_free(void *arg) {
+	free(arg);
+	smrtest_count(&freed);
+}
+
+
+//------------------------------------------------------------------------------
+// hazard -- register thread and hold its hazard pointers until done
+//------------------------------------------------------------------------------
+void *hazard(void *arg) {
+	parm_t	*parm = (parm_t *)arg;
+	int		j;
+
+	parm->hptr[0] = smr_acquire();
+	for (j = 1; j < parm->npairs; j++)
+		parm->hptr[j] = smr_alloc();
+	pthread_barrier_wait(&ready);
+	pthread_barrier_wait(&done);
+
+	return NULL;		// smr node released on exit
+}
+
+
+//------------------------------------------------------------------------------
+// scantest -- average smr_scan time in usecs
+//------------------------------------------------------------------------------
+double scantest(int nthreads, int npairs, int backlog, int nscans) {
+	parm_t		*parms;
+	item_t		**items;
+	smr_domain_t	*d = smr_domain_default();
+	item_t		*item;
+	utime_t		t0, total = 0;
+	int			j, k, m, h;
+
+	parms = (parm_t *)calloc(nthreads, sizeof(parm_t));
+	items = (item_t **)calloc(backlog, sizeof(item_t *));
+
+	pthread_barrier_init(&ready, NULL, nthreads + 1);
+	pthread_barrier_init(&done, NULL, nthreads + 1);
+	for (j = 0; j < nthreads; j++) {
+		parms[j].npairs = npairs;
+		parms[j].hptr = (smr_t **)calloc(npairs, sizeof(smr_t *));
+		pthread_create(&parms[j].tid, NULL, &hazard, &parms[j]);
+	}
+	pthread_barrier_wait(&ready);
+
+	for (k = 0; k < nscans; k++) {
+		pthread_mutex_lockx(&d->rcu_mutex);
+
+		for (j = 0; j < backlog; j++) {
+			items[j] = (item_t *)malloc(sizeof(item_t));
+			smrtest_init(&items[j]->defer, &item_free, items[j]);
+			items[j]->defer.sequence = d->current - 1;
+			smr_enqueue(d, &items[j]->defer);
+		}
+		d->deferred_work += backlog;
+		d->stats.defers += backlog;
+
+		// point each thread's hazard pointers at random backlog items
+		for (j = 0; j < nthreads; j++) {
+			for (m = 0; m < npairs; m++) {
+				atomic_store(&parms[j].hptr[m][0], items[rand() % backlog]);
+				atomic_store(&parms[j].hptr[m][1], items[rand() % backlog]);
+			}
+		}
+
+		t0 = getutimeofday();
+		smr_scan(d);
+		total += getutimeofday() - t0;
+
+		// held items requeued w/ current sequence, then released
+		for (j = 0; j < nthreads; j++) {
+			for (m = 0; m < npairs; m++) {
+				for (h = 0; h < 2; h++) {
+					item = (item_t *)atomic_load(&parms[j].hptr[m][h]);
+					if (item->defer.sequence != d->current)
+						released++;
+					atomic_store(&parms[j].hptr[m][h], NULL);
+				}
+			}
+		}
+
+		pthread_mutex_unlockx(&d->rcu_mutex);
+		pthread_cond_broadcast(&d->rcu_cvar);
+	}
+
+	pthread_barrier_wait(&done);
+	for (j = 0; j < nthreads; j++) {
+		pthread_join(parms[j].tid, NULL);
+		free(parms[j].hptr);
+	}
+
+	pthread_barrier_destroy(&ready);
+	pthread_barrier_destroy(&done);
+	free(items);
+	free(parms);
+
+	return (double)total / (double)nscans;
+}
+
+
+//--------------------------------------------------------------------
+// main --
+//
+//--------------------------------------------------------------------
+int main(int argc, char *argv[]) {
+	int		nthreads = 200;
+	int		npairs = 1;
+	int		backlog = 10000;
+	int		nscans = 10;
+	int		sweep = 0;
+	int		_h = 0;
+	int		n, t, b;
+	double	usec;
+
+	while ((n = getopt(argc, argv, "hr:p:b:n:s")) > -1) {
+		switch ((char)n) {
+			case 'r':
+				nthreads = atoi(optarg);
+				break;
+
+			case 'p':
+				npairs = atoi(optarg);
+				break;
+
+			case 'b':
+				backlog = atoi(optarg);
+				break;
+
+			case 'n':
+				nscans = atoi(optarg);
+				break;
+
+			case 's':
+				sweep = 1;
+				break;
+
+			case 'h':
+			default:
+				_h = 1;
+				break;
+		}
+	}
+
+	if (_h || nthreads < 1 || npairs < 1 || backlog < 1 || nscans < 1) {
+		fprintf(stderr, "usage: %s -<opts>\n", argv[0]);
+		fprintf(stderr, "\n");
+		fprintf(stderr, "where opts =\n");
+		fprintf(stderr, "\t-r  :  number of threads w/ hazard pointers, default 200\n");
+		fprintf(stderr, "\t-p  :  number of hazard pointer pairs per thread, default 1\n");
+		fprintf(stderr, "\t-b  :  backlog of deferred work per scan, default 10000\n");
+		fprintf(stderr, "\t-n  :  number of scans per point, default 10\n");
+		fprintf(stderr, "\t-s  :  sweep threads 1, 2, 4 .. -r and backlog 10, 100 .. -b\n");
+		fprintf(stderr, "\t-h  :  print this help message\n");
+		exit(1);
+	}
+
+	rcu_startup();
+
+	printf("hazard pointer pairs per thread = %d\n", npairs);
+	printf("%8s %8s %12s %12s\n", "threads", "backlog", "usec/scan", "nsec/item");
+	for (t = sweep ? 1 : nthreads; t <= nthreads; t = (t < nthreads && t * 2 > nthreads) ? nthreads : t * 2) {
+		for (b = sweep ? 10 : backlog; b <= backlog; b = (b < backlog && b * 10 > backlog) ? backlog : b * 10) {
+			usec = scantest(t, npairs, b, nscans);
+			printf("%8d %8d %12.1f %12.1f\n", t, b, usec, usec * 1000.0 / (double)b);
+		}
+	}
+
+	rcu_shutdown();
+
+	printf("freed = %ld, held items released = %ld\n", freed, released);
+
+	return (released == 0) ? 0 : 1;
+}
+
+
+/*-*/
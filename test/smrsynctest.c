@@ -0,0 +1,394 @@
+/*
+Copyright 2006 Joseph W. Seigh
+
+Permission to use, copy, modify and distribute this software
+and its documentation for any purpose and without fee is
+hereby granted, provided that the above copyright notice
+appear in all copies, that both the copyright notice and this
+permission notice appear in supporting documentation.  I make
+no representations about the suitability of this software for
+any purpose. It is provided "as is" without express or implied
+warranty.
+
+---
+*/
+
+/*
+ * smr_barrier and smr_synchronize.  Writers defer batches of items and
+ * smr_barrier after each, checking every item they deferred has been
+ * freed.  Syncers call smr_synchronize concurrently and should share
+ * grace periods, syncgps < syncs.  Pollers take smr_get_state cookies
+ * and poll them w/ smr_poll_state.  Then holders defer items and stay
+ * alive w/ them on their retire lists while main, w/o an smr node,
+ * calls smr_barrier, which has to cover them.  Last a reader holds a
+ * hazard pointer to a table main unlinks, and main's smr_synchronize
+ * has to wait for the reader to let go of it.
+ *
+ * link w/ fastsmr.c rcuscan.c smrscan.c fifo.c qcount.c
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <time.h>
+
+#include <fastsmr.h>
+#include <rcustats.h>
+#include <utime.h>
+#include <smrtest.h>
+
+
+typedef struct parm_tt {
+	pthread_t		tid;
+	long			deferred;		// items deferred
+	long			freed;			// items freed, polling thread
+	long			errors;			// barriers w/ items outstanding
+	utime_t			time;			// time in smr_synchronize or polling
+	long			syncs;			// syncs or cookies
+	long			polls;			// smr_poll_state calls
+} parm_t;
+
+typedef struct item_tt {
+	rcu_defer_t		defer;
+	parm_t			*owner;
+} item_t;
+
+static int		nwriters = 4;		// writer threads
+static int		nsyncers = 4;		// smr_synchronize threads
+static int		npollers = 1;		// smr_poll_state threads
+static int		iterations = 200;	// barriers per writer
+static int		count = 100;		// defers per barrier
+static int		buffered = 1;		// writers smr_acquire before deferring
+static int		done = 0;
+
+static pthread_barrier_t	held;		// holders' items deferred
+static pthread_barrier_t	checked;	// main's smr_barrier returned
+
+static item_t	*table;					// reader's hazard pointer target
+static long		loaded = 0;				// reader's hazard pointer set
+static long		released = 0;			// reader about to clear it
+static int		holdms = 50;			// reader holds table msecs
+
+
+//------------------------------------------------------------------------------
+// item_free -- defer function
+//------------------------------------------------------------------------------
+void item_free(void *arg) {
+	item_t	*item = (item_t *)arg;
+
+	smrtest_count(&item->owner->freed);
+	free(item);
+}
+
+
+//------------------------------------------------------------------------------
+// defer_items -- defer count items owned by parm
+//------------------------------------------------------------------------------
+static void defer_items(parm_t *parm) {
+	item_t	*item;
+	int		k;
+
+	for (k = 0; k < count; k++) {
+		item = (item_t *)malloc(sizeof(item_t));
+		item->owner = parm;
+		smrtest_init(&item->defer, &item_free, item);
+		smr_defer(&item->defer);
+		parm->deferred++;
+	}
+}
+
+
+//------------------------------------------------------------------------------
+// writer -- defer count items then smr_barrier, iterations times
+//------------------------------------------------------------------------------
+void *writer(void *arg) {
+	parm_t	*parm = (parm_t *)arg;
+	int		j;
+
+	if (buffered && smr_acquire() == NULL)
+		abort();
+
+	for (j = 0; j < iterations; j++) {
+		defer_items(parm);
+
+		smr_barrier();
+		if (smrtest_get(&parm->freed) != parm->deferred)
+			parm->errors++;
+	}
+
+	return NULL;
+}
+
+
+//------------------------------------------------------------------------------
+// holder -- defer count items and stay alive until main's barrier is checked
+//------------------------------------------------------------------------------
+void *holder(void *arg) {
+	parm_t	*parm = (parm_t *)arg;
+
+	if (buffered && smr_acquire() == NULL)
+		abort();
+
+	defer_items(parm);
+
+	pthread_barrier_wait(&held);
+	pthread_barrier_wait(&checked);
+
+	return NULL;
+}
+
+
+//------------------------------------------------------------------------------
+// crosstest -- smr_barrier from a thread w/o an smr node
+//
+//   Returns the number of holders w/ items not freed by the barrier.
+//------------------------------------------------------------------------------
+long crosstest(int nholders) {
+	parm_t	*parms;
+	long	errors = 0;
+	int		j;
+
+	parms = (parm_t *)calloc(nholders, sizeof(parm_t));
+	pthread_barrier_init(&held, NULL, nholders + 1);
+	pthread_barrier_init(&checked, NULL, nholders + 1);
+
+	for (j = 0; j < nholders; j++)
+		pthread_create(&parms[j].tid, NULL, &holder, &parms[j]);
+	pthread_barrier_wait(&held);
+
+	smr_barrier();
+	for (j = 0; j < nholders; j++) {
+		if (smrtest_get(&parms[j].freed) != parms[j].deferred)
+			errors++;
+	}
+
+	pthread_barrier_wait(&checked);
+	for (j = 0; j < nholders; j++)
+		pthread_join(parms[j].tid, NULL);
+
+	pthread_barrier_destroy(&held);
+	pthread_barrier_destroy(&checked);
+	free(parms);
+
+	return errors;
+}
+
+
+//------------------------------------------------------------------------------
+// reader -- hold a hazard pointer to table for holdms
+//------------------------------------------------------------------------------
+void *reader(void *arg) {
+	struct timespec	ts = {0, holdms * 1000000L};
+	smr_t	*hptr;
+	item_t	*item;
+
+	(void)arg;
+	if ((hptr = smr_acquire()) == NULL)
+		abort();
+
+	item = smrload(&hptr[0], &table);
+	smrtest_count(&loaded);
+
+	nanosleep(&ts, NULL);
+	if (item->owner != NULL)		// table not reused yet
+		abort();
+
+	smrtest_count(&released);
+	smrnull(&hptr[0]);
+	smr_dealloc(hptr);
+
+	return NULL;
+}
+
+
+//------------------------------------------------------------------------------
+// synctest -- smr_synchronize w/ a reader holding a hazard pointer to
+//   the unlinked table
+//
+//   Returns 1 if smr_synchronize returned before the reader let go.
+//------------------------------------------------------------------------------
+long synctest() {
+	pthread_t	tid;
+	item_t		*old;
+	long		errors = 0;
+
+	table = (item_t *)calloc(1, sizeof(item_t));
+	pthread_create(&tid, NULL, &reader, NULL);
+	if (!smrtest_waitfor(&loaded, 1, 1000))
+		abort();
+
+	old = __atomic_exchange_n(&table, NULL, __ATOMIC_ACQ_REL);		// unlink
+	smr_synchronize();
+	if (smrtest_get(&released) == 0)
+		errors++;
+	old->owner = (parm_t *)old;		// reuse, reader checks it
+	pthread_join(tid, NULL);
+	free(old);
+
+	return errors;
+}
+
+
+//------------------------------------------------------------------------------
+// syncer -- smr_synchronize until writers are done
+//------------------------------------------------------------------------------
+void *syncer(void *arg) {
+	parm_t	*parm = (parm_t *)arg;
+	utime_t	t0;
+
+	while (!atomic_load(&done)) {
+		t0 = getutimeofday();
+		smr_synchronize();
+		parm->time += getutimeofday() - t0;
+		parm->syncs++;
+	}
+
+	return NULL;
+}
+
+
+//------------------------------------------------------------------------------
+// poller -- smr_get_state and poll the cookie until writers are done
+//------------------------------------------------------------------------------
+void *poller(void *arg) {
+	parm_t	*parm = (parm_t *)arg;
+	struct timespec	ts = {0, 100000};
+	sequence_t	cookie;
+	utime_t	t0;
+
+	while (!atomic_load(&done)) {
+		t0 = getutimeofday();
+		cookie = smr_get_state();
+		while (!smr_poll_state(cookie)) {
+			parm->polls++;
+			nanosleep(&ts, NULL);
+		}
+		parm->time += getutimeofday() - t0;
+		parm->syncs++;
+	}
+
+	return NULL;
+}
+
+
+//--------------------------------------------------------------------
+// main --
+//
+//--------------------------------------------------------------------
+int main(int argc, char *argv[]) {
+	parm_t		*wparms;
+	parm_t		*sparms;
+	parm_t		*pparms;
+	long		deferred = 0, freed = 0, errors = 0, syncs = 0;
+	long		cookies = 0, polls = 0, xerrors, herrors;
+	utime_t		time = 0, ptime = 0;
+	int			_h = 0;
+	int			n, j;
+	rcu_stats_t	rstats;
+
+	while ((n = getopt(argc, argv, "hw:s:p:i:n:u")) > -1) {
+		switch ((char)n) {
+			case 'w':
+				nwriters = atoi(optarg);
+				break;
+
+			case 's':
+				nsyncers = atoi(optarg);
+				break;
+
+			case 'p':
+				npollers = atoi(optarg);
+				break;
+
+			case 'i':
+				iterations = atoi(optarg);
+				break;
+
+			case 'n':
+				count = atoi(optarg);
+				break;
+
+			case 'u':
+				buffered = 0;
+				break;
+
+			case 'h':
+			default:
+				_h = 1;
+				break;
+		}
+	}
+
+	if (_h || nwriters < 1 || nsyncers < 0 || npollers < 0 || iterations < 1 || count < 0) {
+		fprintf(stderr, "usage: %s -<opts>\n", argv[0]);
+		fprintf(stderr, "\n");
+		fprintf(stderr, "where opts =\n");
+		fprintf(stderr, "\t-w  :  number of writer threads, default 4\n");
+		fprintf(stderr, "\t-s  :  number of smr_synchronize threads, default 4\n");
+		fprintf(stderr, "\t-p  :  number of smr_poll_state threads, default 1\n");
+		fprintf(stderr, "\t-i  :  barriers per writer, default 200\n");
+		fprintf(stderr, "\t-n  :  defers per barrier, default 100\n");
+		fprintf(stderr, "\t-u  :  writers w/o smr_acquire, node made by first defer\n");
+		fprintf(stderr, "\t-h  :  print this help message\n");
+		exit(1);
+	}
+
+	wparms = (parm_t *)calloc(nwriters, sizeof(parm_t));
+	sparms = (parm_t *)calloc(nsyncers, sizeof(parm_t));
+	pparms = (parm_t *)calloc(npollers, sizeof(parm_t));
+
+	rcu_startup();
+	rcu_setMinWait(1);
+
+	for (j = 0; j < nsyncers; j++)
+		pthread_create(&sparms[j].tid, NULL, &syncer, &sparms[j]);
+	for (j = 0; j < npollers; j++)
+		pthread_create(&pparms[j].tid, NULL, &poller, &pparms[j]);
+	for (j = 0; j < nwriters; j++)
+		pthread_create(&wparms[j].tid, NULL, &writer, &wparms[j]);
+
+	for (j = 0; j < nwriters; j++) {
+		pthread_join(wparms[j].tid, NULL);
+		deferred += wparms[j].deferred;
+		freed += smrtest_get(&wparms[j].freed);
+		errors += wparms[j].errors;
+	}
+	atomic_store(&done, 1);
+	for (j = 0; j < nsyncers; j++) {
+		pthread_join(sparms[j].tid, NULL);
+		syncs += sparms[j].syncs;
+		time += sparms[j].time;
+	}
+	for (j = 0; j < npollers; j++) {
+		pthread_join(pparms[j].tid, NULL);
+		cookies += pparms[j].syncs;
+		polls += pparms[j].polls;
+		ptime += pparms[j].time;
+	}
+
+	xerrors = crosstest(nwriters);
+	herrors = synctest();
+
+	copyStats(&rstats);
+	rcu_shutdown();
+
+	printf("freed = %ld of %ld, barrier errors = %ld\n", freed, deferred, errors);
+	printf("barriers = %d, barrierepochs = %d\n", rstats.barriers, rstats.barrierepochs);
+	printf("syncs = %d, syncgps = %d, avg sync usec = %llu\n", rstats.syncs, rstats.syncgps,
+		(syncs > 0) ? time / syncs : 0);
+	printf("cookies = %ld, states = %d, polls = %ld, avg cookie usec = %llu\n", cookies, rstats.states, polls,
+		(cookies > 0) ? ptime / cookies : 0);
+	printf("cross thread barrier errors = %ld of %d\n", xerrors, nwriters);
+	printf("smr_synchronize w/ hazard pointer held errors = %ld\n", herrors);
+
+	free(wparms);
+	free(sparms);
+	free(pparms);
+
+	return (errors == 0 && xerrors == 0 && herrors == 0 && freed == deferred) ? 0 : 1;
+}
+
+
+/*-*/
@@ -0,0 +1,95 @@
+/*
+Copyright 2006 Joseph W. Seigh
+
+Permission to use, copy, modify and distribute this software
+and its documentation for any purpose and without fee is
+hereby granted, provided that the above copyright notice
+appear in all copies, that both the copyright notice and this
+permission notice appear in supporting documentation.  I make
+no representations about the suitability of this software for
+any purpose. It is provided "as is" without express or implied
+warranty.
+
+---
+*/
+
+//------------------------------------------------------------------------------
+// smrtest.h -- scaffolding shared by the smr test programs
+//
+//   Counters shared w/ the polling thread or callback workers go
+//   through smrtest_count/smrtest_get, and hazard pointers through
+//   smrload/smrnull (atomix.h), so the tests run clean under tsan.
+//
+//------------------------------------------------------------------------------
+
+#ifndef SMRTEST_H
+#define SMRTEST_H
+
+#include <stdlib.h>
+#include <time.h>
+
+#include <fastsmr.h>
+#include <atomix.h>
+#include <utime.h>
+
+
+//------------------------------------------------------------------------------
+// smrtest_norefs -- trace callback, items have no links
+//------------------------------------------------------------------------------
+static void smrtest_norefs(void *arg, refcb_t cb) {
+	(void)arg;
+	(void)cb;
+}
+
+//------------------------------------------------------------------------------
+// smrtest_init -- set up deferred work for an item w/ no links
+//------------------------------------------------------------------------------
+static inline void smrtest_init(rcu_defer_t *defer, void (*func)(void *), void *arg) {
+	defer->func = func;
+	defer->arg = arg;
+	defer->forrefs = &smrtest_norefs;
+	defer->type = trace;
+}
+
+
+//------------------------------------------------------------------------------
+// smrtest_count -- bump a counter from any thread
+// smrtest_get -- read a counter
+//------------------------------------------------------------------------------
+static inline void smrtest_count(long *count) {
+	__atomic_fetch_add(count, 1, __ATOMIC_RELAXED);
+}
+
+static inline long smrtest_get(long *count) {
+	return __atomic_load_n(count, __ATOMIC_ACQUIRE);
+}
+
+
+//------------------------------------------------------------------------------
+// smrtest_waitfor -- wait up to msecs for *count to reach n
+//
+//   returns 1 if it did, 0 on timeout
+//------------------------------------------------------------------------------
+static inline int smrtest_waitfor(long *count, long n, int msecs) {
+	struct timespec	ts = {0, 1000000};
+	int		j;
+
+	for (j = 0; j < msecs && smrtest_get(count) < n; j++)
+		nanosleep(&ts, NULL);
+
+	return smrtest_get(count) >= n;
+}
+
+
+//------------------------------------------------------------------------------
+// smrtest_spin -- burn usecs of cpu, stand in for a slow destructor
+//------------------------------------------------------------------------------
+static inline void smrtest_spin(int usecs) {
+	utime_t	t = getutimeofday() + usecs;
+
+	while (getutimeofday() < t);
+}
+
+#endif /* SMRTEST_H */
+
+/*-*/
@@ -0,0 +1,215 @@
+/*
+Copyright 2006 Joseph W. Seigh
+
+Permission to use, copy, modify and distribute this software
+and its documentation for any purpose and without fee is
+hereby granted, provided that the above copyright notice
+appear in all copies, that both the copyright notice and this
+permission notice appear in supporting documentation.  I make
+no representations about the suitability of this software for
+any purpose. It is provided "as is" without express or implied
+warranty.
+
+---
+*/
+
+/*
+ * deferred work callback throughput w/ callbacks run inline on the
+ * polling thread (-k 0) or by a worker pool (-k n).  Each callback
+ * spins (-c) or sleeps (-s) for a number of usecs to stand in for
+ * destructors that do real work.  With -d each callback defers a
+ * child item from the callback thread; one smr_barrier has to cover
+ * all the parents and a second one the children.
+ *
+ * link w/ fastsmr.c rcuscan.c smrscan.c fifo.c qcount.c
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <time.h>
+
+#include <fastsmr.h>
+#include <rcustats.h>
+#include <utime.h>
+#include <smrtest.h>
+
+
+typedef struct item_tt {
+	rcu_defer_t		defer;
+	long			val;
+} item_t;
+
+static int		cost = 20;			// usecs per callback
+static int		sleeping = 0;		// sleep rather than spin
+static int		chained = 0;		// callbacks defer a child item
+static long		freed = 0;			// items freed, any callback thread
+static long		parents = 0;		// writers' items freed
+
+
+void item_free(void *arg);
+
+//------------------------------------------------------------------------------
+// item_defer -- defer an item, val < 0 for a child
+//------------------------------------------------------------------------------
+static void item_defer(long val) {
+	item_t	*item = (item_t *)malloc(sizeof(item_t));
+
+	item->val = val;
+	smrtest_init(&item->defer, &item_free, item);
+	smr_defer(&item->defer);
+}
+
+//------------------------------------------------------------------------------
+// item_free -- defer function, cost usecs
+//------------------------------------------------------------------------------
+void item_free(void *arg) {
+	struct timespec	ts = {0, cost * 1000};
+	item_t	*item = (item_t *)arg;
+
+	if (sleeping)
+		nanosleep(&ts, NULL);
+	else
+		smrtest_spin(cost);
+
+	if (item->val >= 0) {
+		if (chained)
+			item_defer(-1);		// callback thread, no smr node
+		smrtest_count(&parents);
+	}
+
+	free(item);
+	smrtest_count(&freed);
+}
+
+
+//------------------------------------------------------------------------------
+// writer -- defer count items
+//------------------------------------------------------------------------------
+void *writer(void *arg) {
+	long	count = *(long *)arg;
+	long	j;
+
+	if (smr_acquire() == NULL)
+		abort();
+
+	for (j = 0; j < count; j++)
+		item_defer(j);
+
+	return NULL;		// retire list handed off on exit
+}
+
+
+//--------------------------------------------------------------------
+// main --
+//
+//--------------------------------------------------------------------
+int main(int argc, char *argv[]) {
+	pthread_t	*tids;
+	int		nthreads = 2;
+	long	count = 20000;
+	int		workers = 0;
+	int		batch = 0;
+	int		_h = 0;
+	int		n, j;
+	long	total, expected;
+	long	pfreed, afreed;
+	utime_t	t0, t1;
+	rcu_stats_t	rstats;
+
+	while ((n = getopt(argc, argv, "hr:n:k:b:c:sd")) > -1) {
+		switch ((char)n) {
+			case 'r':
+				nthreads = atoi(optarg);
+				break;
+
+			case 'n':
+				count = atol(optarg);
+				break;
+
+			case 'k':
+				workers = atoi(optarg);
+				break;
+
+			case 'b':
+				batch = atoi(optarg);
+				break;
+
+			case 'c':
+				cost = atoi(optarg);
+				break;
+
+			case 's':
+				sleeping = 1;
+				break;
+
+			case 'd':
+				chained = 1;
+				break;
+
+			case 'h':
+			default:
+				_h = 1;
+				break;
+		}
+	}
+
+	if (_h || nthreads < 1 || count < 1 || workers < 0 || batch < 0 || cost < 0 || cost >= 1000000) {
+		fprintf(stderr, "usage: %s -<opts>\n", argv[0]);
+		fprintf(stderr, "\n");
+		fprintf(stderr, "where opts =\n");
+		fprintf(stderr, "\t-r  :  number of writer threads, default 2\n");
+		fprintf(stderr, "\t-n  :  number of defers per thread, default 20000\n");
+		fprintf(stderr, "\t-k  :  callback worker threads, 0 = inline, default 0\n");
+		fprintf(stderr, "\t-b  :  max callbacks per worker batch, 0 = default\n");
+		fprintf(stderr, "\t-c  :  usecs per callback, default 20\n");
+		fprintf(stderr, "\t-s  :  callbacks sleep rather than spin\n");
+		fprintf(stderr, "\t-d  :  callbacks defer a child item\n");
+		fprintf(stderr, "\t-h  :  print this help message\n");
+		exit(1);
+	}
+
+	tids = (pthread_t *)calloc(nthreads, sizeof(pthread_t));
+	total = nthreads * count;
+	expected = chained ? total * 2 : total;
+
+	rcu_startup();
+	rcu_setMinWait(1);
+	rcu_setWorkers(workers, batch);
+
+	t0 = getutimeofday();
+	for (j = 0; j < nthreads; j++)
+		pthread_create(&tids[j], NULL, &writer, &count);
+	for (j = 0; j < nthreads; j++)
+		pthread_join(tids[j], NULL);
+
+	smr_barrier();
+	t1 = getutimeofday();
+	pfreed = smrtest_get(&parents);
+
+	if (chained)
+		smr_barrier();		// children deferred before it
+	afreed = smrtest_get(&freed);
+
+	copyStats(&rstats);
+	rcu_shutdown();
+
+	if (t1 <= t0)
+		t1 = t0 + 1;
+	printf("workers = %d, %d usec %s callbacks\n", workers, cost, sleeping ? "sleeping" : "spinning");
+	printf("freed = %ld of %ld, callbacks/msec = %.1f\n", afreed, expected, (double)total * 1000.0 / (double)(t1 - t0));
+	printf("cbtime = %llu, cbmax = %llu, handoffs = %d, batches = %d, gpmax = %llu\n",
+		rstats.cbtime, rstats.cbmax, rstats.handoffs, rstats.batches, rstats.gpmax);
+
+	free(tids);
+
+	if (pfreed != total)
+		printf("error: %ld of %ld items freed by first barrier\n", pfreed, total);
+
+	return (pfreed == total && afreed == expected) ? 0 : 1;
+}
+
+
+/*-*/
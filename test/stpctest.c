@@ -45,6 +45,7 @@
 typedef struct _data_t {
     struct _data_t *next;
     long val;
+    long cookie;        // stpcGetCookie at retire, testcase 7
 } data_t;
 
 static bool run = true;
@@ -409,6 +410,61 @@ void *testWrite6(void *arg) {
     return NULL;
 }
 
+/*
+ * Retired data kept on a local fifo w/ a polled cookie and reused once
+ * the cookie completes, no deferred delete callback.
+ */
+void *testWrite7(void *arg) {
+    testparm *parm = (testparm *) arg;
+	pthread_setspecific(parmKey, parm);
+    stpcNode *refNode;
+    data_t *head = NULL, *tail = NULL;     // retired, oldest first
+    data_t *item;
+    
+    for (int j = 0; j < parm->count; j++) {
+        for (;;)
+        {
+            if (head != NULL && stpcPollCookie(parm->proxy, head->cookie)) {
+                item = head;
+                if ((head = item->next) == NULL)
+                    tail = NULL;
+                break;
+            }
+            refNode = stpcGetProxyNodeReference(parm->proxy);
+            item = pop_lf();
+            stpcDropProxyNodeReference(parm->proxy, refNode);
+			if (item != NULL)
+				break;
+            sched_yield();
+        }
+
+        // swap current with item
+        item->val = atomic_fetch_add_explicit(&dataseq, 1, memory_order_relaxed) + 1;
+        item = atomic_exchange_explicit(&current, item, memory_order_acquire);
+        atomic_store_explicit(&item->val, -(item->val), memory_order_relaxed);  // mark stale
+
+        item->cookie = stpcGetCookie(parm->proxy);
+        item->next = NULL;
+        if (tail != NULL)
+            tail->next = item;
+        else
+            head = item;
+        tail = item;
+    }
+
+    // return retired data to the free pool as cookies complete
+    while ((item = head) != NULL) {
+        if (stpcPollCookie(parm->proxy, item->cookie)) {
+            head = item->next;
+            push_lf(item);
+        }
+        else
+            sched_yield();
+    }
+    
+    return NULL;
+}
+
 void *testRead(void *arg) {
     testparm *parm = (testparm *) arg;
 	pthread_setspecific(parmKey, parm);
@@ -559,7 +615,8 @@ int main(int argc, char **argv) {
 		"lock-free readers, locked writers w/ busy polling",
 		"lock-free readers, locked writers w/ semaphore",
 		"locked reader/writers w/ condvar",
-		"reader/writers w/ rwlock, data queue w/ mutex"
+		"reader/writers w/ rwlock, data queue w/ mutex",
+		"lock-free readers, writers reuse data w/ polled cookies"
 	};
 	void *(*writeTest[])(void *) = {
 		testWrite0,
@@ -568,7 +625,8 @@ int main(int argc, char **argv) {
 		testWrite3,
 		testWrite4,
 		testWrite5,
-		testWrite6
+		testWrite6,
+		testWrite7
 	};
 	void *(*readTest[])(void *) = {
 		testRead,
@@ -577,7 +635,8 @@ int main(int argc, char **argv) {
 		testRead,
 		testRead,
 		testRead5,
-		testRead6
+		testRead6,
+		testRead
 	};
 	int max_test_number = sizeof(testdesc)/sizeof(char*);
     